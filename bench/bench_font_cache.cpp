@@ -0,0 +1,81 @@
+//==============================================================================
+/**
+\file            bench_font_cache.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+  Cost of a Font cache lookup with many live strings. Every frame prints
+  the same N strings, so after the first frame each print is a cache hit;
+  the time per print should not grow with N. Uses a headless face
+  (FaceFlags::Headless), no GL context is needed.
+
+  Usage: bench_font_cache <font file> [size in pt]
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nFont.hpp"
+#include "nFontFace.hpp"
+
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+
+typedef int64_t   Time_t;   // usec
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+Time_t curr_time(){
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return static_cast<Time_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+//--------------------------------------------------------------------//
+/// Prints \a count strings, one per line.
+//--------------------------------------------------------------------//
+void print_frame(ngl::Font &font, int count){
+  char line[32];
+  font.init_position(768);
+  for(int i=0; i < count; ++i){
+    snprintf(line, sizeof(line), "%d\n", i);
+    font.print(line);
+  }
+}
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int main(int argc, char **argv){
+  const int kCounts[]={ 1000, 10000, 100000 };
+  const int kFrames  =10;
+
+  if( argc < 2 ){
+    fprintf(stderr, "Usage: %s <font file> [size in pt]\n", argv[0]);
+    return 1;
+  }
+  const size_t size=( argc > 2 ? atoi(argv[2]) : 12 );
+
+  if( !ngl::freetype::init() )
+    return 1;
+  for(size_t c=0; c < sizeof(kCounts)/sizeof(kCounts[0]); ++c){
+    const int count=kCounts[c];
+    ngl::Font font(argv[1], size, ngl::FaceFlags::Headless);
+
+    // First frame fills the cache.
+    print_frame(font, count);
+    font.update_cache();
+
+    const size_t hits   =font.cache_hits();
+    const size_t misses =font.cache_misses();
+    Time_t       lookup =0;
+    for(int frame=0; frame < kFrames; ++frame){
+      Time_t start=curr_time();
+      print_frame(font, count);
+      lookup+=curr_time() - start;
+      font.update_cache();
+    }
+
+    printf("%6d strings: %8.1f ns/print, hits %zu, misses %zu\n",
+           count, lookup * 1000.0 / ((double)count * kFrames),
+           font.cache_hits() - hits, font.cache_misses() - misses);
+  }
+  ngl::freetype::cleanup();
+  return 0;
+}
@@ -0,0 +1,91 @@
+//==============================================================================
+/**
+\file            bench_glyph_lookup.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+  Per character glyph lookup cost as a function of the number of loaded
+  glyphs. Compares GlyphTable with a linear scan over the glyph storage
+  (what FontFace::get_glyph used to do).
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nGlyphTable.hpp"
+#include "nFontFace.hpp"
+
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+
+typedef int64_t   Time_t;   // usec
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+Time_t curr_time(){
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return static_cast<Time_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+//--------------------------------------------------------------------//
+/// Fills \a glyphs with \a count glyphs. The first 96 are printable ASCII,
+/// the rest is spread over the whole code space (many table pages).
+//--------------------------------------------------------------------//
+void make_glyphs(ngl::Glyphs &glyphs, ngl::GlyphTable &table,
+                 std::vector<uint32_t> &codes, size_t count){
+  for(size_t i=0; i < count; ++i){
+    uint32_t code =( i < 96 ? 32+i : 0x100 + (i * 2654435761u) % 0x10fe00 );
+    glyphs.push_back(ngl::Glyph::null);
+    glyphs.back().advance =static_cast<float>(i & 0x0f);
+    table.insert(code, &glyphs.back());
+    codes.push_back(code);
+  }
+}
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int main(){
+  const size_t  kCounts[]   ={16, 96, 256, 1024, 4096, 16384};
+  const size_t  kLookups    =1 << 22;
+  const size_t  kMaxLinear  =4096;
+
+  printf("%8s %16s %16s\n", "glyphs", "table ns/char", "linear ns/char");
+  for(size_t c=0; c < sizeof(kCounts)/sizeof(kCounts[0]); ++c){
+    ngl::Glyphs           glyphs;
+    ngl::GlyphTable       table;
+    std::vector<uint32_t> codes;
+    make_glyphs(glyphs, table, codes, kCounts[c]);
+
+    // Text to "lay out": 3/4 ASCII, 1/4 whatever else is loaded.
+    std::vector<uint32_t> text(kLookups);
+    size_t ascii =( codes.size() < 96 ? codes.size() : 96 );
+    srand(1234);
+    for(size_t i=0; i < kLookups; ++i)
+      text[i] =codes[ rand() % ( (rand() & 3) ? ascii : codes.size() ) ];
+
+    float   sum   =0.0f;
+    Time_t  start =curr_time();
+    for(size_t i=0; i < kLookups; ++i)
+      sum+=table.find(text[i])->advance;
+    double  tableNs =(curr_time()-start) * 1000.0 / kLookups;
+
+    double  linearNs=0.0;
+    if( kCounts[c] <= kMaxLinear ){
+      start =curr_time();
+      for(size_t i=0; i < kLookups; ++i){
+        for(size_t g=0; g < codes.size(); ++g){
+          if( codes[g] == text[i] ){
+            sum+=glyphs[g].advance;
+            break;
+          }
+        }
+      }
+      linearNs =(curr_time()-start) * 1000.0 / kLookups;
+    }
+
+    if( kCounts[c] <= kMaxLinear )
+      printf("%8zu %16.2f %16.2f   (%g)\n",
+             kCounts[c], tableNs, linearNs, sum);
+    else
+      printf("%8zu %16.2f %16s   (%g)\n", kCounts[c], tableNs, "-", sum);
+  }
+  return 0;
+}
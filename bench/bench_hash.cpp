@@ -0,0 +1,61 @@
+//==============================================================================
+/**
+\file            bench_hash.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+  Throughput of gen_hash (byte at a time, 32 bit, used for cache file
+  names) and gen_hash64 (word at a time, 64 bit, used for Font cache
+  keys) for strings of a few lengths.
+
+  Usage: bench_hash
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nFontTypes.hpp"
+
+#include <sys/time.h>
+#include <cstdio>
+
+typedef int64_t   Time_t;   // usec
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+Time_t curr_time(){
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return static_cast<Time_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int main(){
+  const size_t kLengths[]={ 8, 32, 128, 1024 };
+  const size_t kBytes    =256*1024*1024;   // hashed per length and hash.
+
+  for(size_t l=0; l < sizeof(kLengths)/sizeof(kLengths[0]); ++l){
+    const size_t  length=kLengths[l];
+    const size_t  count =kBytes / length;
+    ngl::String   str(length, 'x');
+    for(size_t i=0; i < length; ++i)
+      str[i]=(char)('a' + (i*7) % 26);
+
+    // The results are chained, so the loops can not be optimized away.
+    ngl::Hash_t   hash32=0;
+    Time_t        start =curr_time();
+    for(size_t i=0; i < count; ++i)
+      hash32=ngl::gen_hash(str, hash32);
+    Time_t        t32   =curr_time() - start;
+
+    ngl::Hash64_t hash64=0;
+    start=curr_time();
+    for(size_t i=0; i < count; ++i)
+      hash64=ngl::gen_hash64(str.data(), length, hash64);
+    Time_t        t64   =curr_time() - start;
+
+    printf("%5zu bytes: gen_hash %7.1f MB/s, gen_hash64 %7.1f MB/s"
+           "  (%08x %016llx)\n",
+           length, kBytes / (double)t32, kBytes / (double)t64,
+           hash32, (unsigned long long)hash64);
+  }
+  return 0;
+}
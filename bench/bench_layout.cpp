@@ -0,0 +1,88 @@
+//==============================================================================
+/**
+\file            bench_layout.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+  Text layout cost per frame (Font::print, update_cache and get_geometry),
+  with headless faces (FaceFlags::Headless), so no GL context or display
+  is needed. Each frame prints some static lines, which hit the Font
+  cache, and some that change every frame.
+
+  Usage: bench_layout <font file> [size in pt]
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nFont.hpp"
+#include "nFontFace.hpp"
+
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef int64_t   Time_t;   // usec
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+Time_t curr_time(){
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return static_cast<Time_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int main(int argc, char **argv){
+  const int     kFrames       =2000;
+  const int     kStaticLines  =20;
+  const int     kDynamicLines =5;
+
+  if( argc < 2 ){
+    fprintf(stderr, "Usage: %s <font file> [size in pt]\n", argv[0]);
+    return 1;
+  }
+  const size_t size=( argc > 2 ? atoi(argv[2]) : 12 );
+
+  if( !ngl::freetype::init() )
+    return 1;
+  {
+    ngl::Font font(argv[1], size, ngl::FaceFlags::Headless);
+    std::vector<ngl::Font::Vertex>  vb;
+    ngl::Font::Batches              batches;
+    char                            line[128];
+
+    Time_t  layout  =0;
+    Time_t  geometry=0;
+    size_t  tris    =0;
+    for(int frame=0; frame < kFrames; ++frame){
+      Time_t start=curr_time();
+      font.init_position(768);
+      for(int i=0; i < kStaticLines; ++i){
+        snprintf(line, sizeof(line),
+                 "Static line %d: the quick brown fox jumps over it\n", i);
+        font.print(line);
+      }
+      for(int i=0; i < kDynamicLines; ++i){
+        snprintf(line, sizeof(line), "^3Frame ^7%d^0, value %d\n",
+                 frame, (frame * 7919 + i) % 100000);
+        font.cprint(line);
+      }
+      font.update_cache();
+      Time_t mid=curr_time();
+
+      vb.resize( font.vertex_count() );
+      font.get_geometry(&vb[0], batches);
+      tris+=font.tri_count();
+
+      layout  +=mid - start;
+      geometry+=curr_time() - mid;
+    }
+
+    printf("%d frames, %zu tris/frame, atlas pages %zu\n",
+           kFrames, tris / kFrames, font.face()->atlas()->pages());
+    printf("layout   %8.2f us/frame\n", (double)layout   / kFrames);
+    printf("geometry %8.2f us/frame\n", (double)geometry / kFrames);
+  }
+  ngl::freetype::cleanup();
+  return 0;
+}
@@ -0,0 +1,62 @@
+//==============================================================================
+/**
+\file            AtlasRepacker.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_ATLASREPACKER_HPP__)
+#define __FONTS_ATLASREPACKER_HPP__
+
+#include "nFontTypes.hpp"
+#include "nSkylinePacker.hpp"
+#include <vector>
+
+namespace ngl{
+  //============================================================================
+  //{{{ AtlasLayout
+  /** New layout of an atlas: where every glyph goes, and the packers of the
+      resulting pages (so the atlas can keep adding glyphs after it).
+   */
+  //============================================================================
+  struct AtlasLayout{
+    Size2                         pageSize;
+    size_t                        maxPages;
+    std::vector<AtlasTransfer>    transfers;
+    std::vector<SkylinePacker>    pages;
+
+    bool  add(AtlasTransfer &transfer);
+  };//}}}
+
+  //============================================================================
+  //{{{ AtlasRepacker
+  /** Computes a compact atlas layout on a worker thread.
+
+    start() takes the current place of every glyph, tallest glyphs are then
+    packed first into as few pages as possible. The layout is picked up
+    with collect() on the GL thread and applied with IGlyphAtlas::repack().
+    The worker never touches the glyphs or the atlas.
+   */
+  //============================================================================
+  class AtlasRepacker{
+      AtlasRepacker(const AtlasRepacker &obj)             = delete;
+      AtlasRepacker& operator=(const AtlasRepacker &obj)  = delete;
+    public:
+      AtlasRepacker();
+      ~AtlasRepacker();
+
+      bool  start(std::vector<AtlasTransfer> &transfers,
+                  const Size2 &pageSize, size_t maxPages);
+      bool  collect(AtlasLayout &out);
+      bool  busy() const;
+
+    private:
+      struct Pimpl;
+      Pimpl   *d;
+  };//}}}
+}
+#endif/* __FONTS_ATLASREPACKER_HPP__ */
@@ -0,0 +1,70 @@
+//==============================================================================
+/**
+\file            BlockArena.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_BLOCKARENA_HPP__)
+#define __FONTS_BLOCKARENA_HPP__
+
+#include "nFontTypes.hpp"
+#include <vector>
+
+namespace ngl{
+  //============================================================================
+  //{{{ BlockArena
+  /** Bump allocator over blocks of memory, for data that dies in bulk.
+
+    alloc() carves from the current block; free() only counts the bytes
+    still in use in a block, and a block is recycled (kept for later
+    allocations, not returned to the heap) once nothing in it is in use.
+    Once the blocks are there, allocating and freeing does not touch the
+    heap.
+
+    Live allocations scattered over mostly dead blocks keep those blocks
+    from being recycled, see fragmentation(). The owner compacts by calling
+    seal() and then moving every live allocation into a new one; the moves
+    empty the old blocks.
+   */
+  //============================================================================
+  class BlockArena{
+      BlockArena(const BlockArena &obj)             = delete;
+      BlockArena& operator=(const BlockArena &obj)  = delete;
+    public:
+      static const size_t kAlignment=8;
+
+      BlockArena(size_t blockSize=64*1024);
+      ~BlockArena();
+
+      void*   alloc(size_t size, uint32_t &block);
+      void    free(uint32_t block, size_t size);
+      void    seal();
+
+      size_t  live()      const { return m_live;      }
+      size_t  capacity()  const { return m_capacity;  }
+      float   fragmentation() const;
+
+    private:
+      struct Block{
+        byte    *data;
+        size_t  size;
+        size_t  top;    // bytes handed out.
+        size_t  live;   // bytes handed out and not freed.
+      };
+
+      uint32_t  next_block(size_t size);
+
+      std::vector<Block>    m_blocks;
+      std::vector<uint32_t> m_free;     // empty blocks.
+      uint32_t              m_current;  // allocated from, or kNone.
+      size_t                m_blockSize;
+      size_t                m_live;
+      size_t                m_capacity;
+  };//}}}
+}
+#endif/* __FONTS_BLOCKARENA_HPP__ */
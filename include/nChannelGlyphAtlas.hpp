@@ -0,0 +1,53 @@
+#ifndef __NOVO_CHANNELGLYPHATLAS_HPP__
+#define __NOVO_CHANNELGLYPHATLAS_HPP__
+#include "nFontTypes.hpp"
+#include "nMemoryGlyphAtlas.hpp"
+#include <memory>
+
+namespace ngl{
+  //============================================================================
+  //{{{ ChannelGlyphAtlas
+  /** Glyph atlas living in one channel of a shared RGBA texture.
+
+    Up to kChannels faces (with the same page size and filtering) share the
+    same textures, each in a channel of its own, so text of several fonts
+    is drawn without switching textures. channel() tells the renderers
+    which one to sample: they swizzle it into alpha (ARB_texture_swizzle)
+    before drawing, see AbstractRenderer::bind_batch.
+
+    Every face still packs its own glyphs (see MemoryGlyphAtlas); its
+    bitmaps are interleaved into the shared RGBA copy of the page by
+    flush(), which uploads the changed rectangle. The textures are freed
+    with the last face using them.
+  */
+  //============================================================================
+  class ChannelGlyphAtlas: public MemoryGlyphAtlas{
+      ChannelGlyphAtlas(const ChannelGlyphAtlas &obj);
+      ChannelGlyphAtlas& operator=(const ChannelGlyphAtlas &obj);
+    public:
+      static const size_t kChannels=4;
+
+      ChannelGlyphAtlas(size_t width, size_t height, bool linear=false);
+      virtual ~ChannelGlyphAtlas();
+
+      Error         flush();
+      size_t        uploaded() const            { return m_uploaded; }
+      TextureID     texid(size_t page=0) const;
+      int           channel() const             { return m_channel;  }
+
+      static bool   supported();
+
+    protected:
+      void  page_added(size_t page);
+      void  page_removed(size_t page);
+
+    private:
+      struct Shared;
+
+      std::shared_ptr<Shared> m_shared;
+      int                     m_channel;
+      size_t                  m_uploaded;   // bytes, by all flush() calls.
+  };//}}}
+}
+
+#endif/* __NOVO_CHANNELGLYPHATLAS_HPP__ */
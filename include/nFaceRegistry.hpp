@@ -0,0 +1,48 @@
+//==============================================================================
+/**
+\file            FaceRegistry.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_FACEREGISTRY_HPP__)
+#define __FONTS_FACEREGISTRY_HPP__
+
+#include "nFontTypes.hpp"
+
+namespace ngl{
+  class FontFace;
+
+  //============================================================================
+  //{{{ FaceRegistryStats
+  /** Counters of the face registry.
+   */
+  //============================================================================
+  struct FaceRegistryStats{
+    size_t      faces;        ///< Faces currently alive.
+    size_t      references;   ///< Outstanding acquire() calls.
+    size_t      created;      ///< Faces loaded since startup.
+    size_t      hits;         ///< acquire() calls served by a loaded face.
+    size_t      memorySaved;  ///< Sum of FontFace::memory_usage() at each hit.
+  };//}}}
+
+  /** Reference counted FontFace instances, shared by everyone asking for the
+      same face file, size and flags. Each face owns its atlas, so sharing the
+      face shares the atlas texture and the rasterized glyphs as well.
+      SDF faces are always loaded at sdf::kReferenceSize, so a single one is
+      shared by all sizes.
+      Meant to be used from the GL thread only.
+   */
+  namespace faces{
+    extern FontFace*                acquire(const String  &face,
+                                            size_t        sizeInPt,
+                                            uint32_t      flags=FaceFlags::None);
+    extern void                     release(FontFace *face);
+    extern const FaceRegistryStats& stats();
+  }
+}
+#endif/* __FONTS_FACEREGISTRY_HPP__ */
@@ -13,6 +13,7 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #define __FONTS_FONT_HPP__
 
 #include "nFontTypes.hpp"
+#include "nBlockArena.hpp"
 #include <vector>
 #include <list>
 
@@ -20,29 +21,47 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 namespace ngl{
 
   //==============================================================================
-  /** \classHashTable
+  /** \class HashTable
   \brief  Hash table implementation.
+
+    Open addressing with linear probing over a single array of slots, so a
+    lookup usually touches one or two cache lines and nothing is allocated
+    per entry. The keys are hashes already (the table does not see what
+    was hashed, users have to check for collisions); they are spread over
+    the slots by Fibonacci hashing. The table doubles when it gets 3/4
+    full.
+
+    erase() shifts the following entries of the probe sequence back
+    instead of leaving a tombstone, so lookups never slow down with churn.
   */
   //==============================================================================
   template<typename Type>
   class HashTable{
       struct Slot{
-        Hash_t  hash;
-        Slot    *next;
-        Slot    *prev;
-        Type    data;
+        Hash64_t  hash;
+        bool      used;
+        Type      data;
       };
     public:
-      HashTable();
-      HashTable(const HashTable &obj);
-      virtual ~HashTable();
+      HashTable(size_t capacity=16);
 
-      HashTable& operator=(const HashTable &obj);
+      Type*       find(Hash64_t hash);
+      const Type* find(Hash64_t hash) const;
+      Type&       insert(Hash64_t hash, const Type &data);
+      bool        erase(Hash64_t hash);
+      void        clear();
 
-      void init(size_t capacity, size_t tableSize);
+      size_t      size()      const { return m_size;          }
+      size_t      capacity()  const { return m_slots.size();  }
 
     private:
-      
+      size_t  home(Hash64_t hash) const;
+      size_t  locate(Hash64_t hash) const;
+      void    rehash(size_t capacity);
+
+      std::vector<Slot>   m_slots;  // power of two.
+      size_t              m_size;
+      uint32_t            m_shift;  // 64 - log2(capacity).
   };
 
   struct FontStdAllocPolicy{
@@ -64,8 +83,35 @@ namespace ngl{
     public:
       struct RenderRequest;
       struct Vertex;
+      struct Batch;
+      struct Draw;
+      typedef std::vector<Batch>        Batches;
+
+      //========================================================
+      /** The cached text at stable offsets of one vertex buffer, kept up
+        to date by update_cache(). A renderer mirroring it in a buffer
+        object uploads the uploads ranges if it saw prevSerial, the whole
+        of vb otherwise.
+
+        The vertices are local to their string, every print of it is a
+        Draw moved to where it was printed. The quads of a string are
+        consecutive for each atlas page, so a Draw indexes them with
+        quad_indices() like get_geometry()'s batches.
+       */
+      //========================================================
+      struct Resident{
+        const Vertex              *vb;          // capacity vertices.
+        size_t                    capacity;
+        uint32_t                  serial;       // of the last update.
+        uint32_t                  prevSerial;   // uploads are relative to.
+        std::vector<Chunk>        uploads;      // vertex ranges written.
+        std::vector<Draw>         draws;        // in drawing order.
+      };
+
+      /// Quads a 16 bit index can address.
+      static const size_t kMaxQuads=65536/4;
       
-      Font(const String &face, size_t sizeInPt);
+      Font(const String &face, size_t sizeInPt, uint32_t faceFlags=0);
       virtual ~Font();
 
       size_t  tri_count()                                                 const;
@@ -75,31 +121,79 @@ namespace ngl{
       void set_position(const int2 &position);
       void print(const String &msg, const Color32 &color=Color32::white);
       void cprint(const String &msg);
-      void get_geometry(Vertex *vb, Triangle16 *ib, TextureID &texID)  const;
+      void get_geometry(Vertex *vb, Batches &batches)                  const;
       void update_cache();
 
+      size_t text_width(const String &text);
+      size_t split(const String &text, size_t width, StringList &lines,
+                   TextWrapMode wrapMode=TextWrap::LineWrap);
+
+      static const Triangle16* quad_indices();
+
+      const Resident& resident() const { return m_resident; }
+
       FontFace *face() { return m_face; }
-      
+      bool      is_sdf()  const;
+      float     scale()   const { return m_scale; }
+
+      size_t    cache_hits()    const { return m_cacheHits;   }
+      size_t    cache_misses()  const { return m_cacheMisses; }
+
+    protected:
+      virtual Hash64_t  cache_key(const String &msg, const Color32 &color,
+                                  bool colorCodes) const;
+
     private:
       struct CacheEntry;
+      struct Instance;
+      typedef std::vector<Instance>     Instances;
       typedef std::vector<Vertex>       Vertices;
       typedef std::vector<Triangle16>   Triangles;
-      typedef std::list<CacheEntry>     Cache;
+      typedef std::vector<CacheEntry>   Cache;    // in drawing order.
+      typedef HashTable<uint32_t>       CacheIndex;
       
 
-      CacheEntry* cache(const String &msg);
-      CacheEntry* find_cached(const String &msg);
+      uint32_t*   probe(Hash64_t &key, const String &msg,
+                        const Color32 &color, bool colorCodes);
+      CacheEntry* cache(Hash64_t key, const String &msg,
+                        const Color32 &color, bool colorCodes);
+      CacheEntry* find_cached(Hash64_t key, const String &msg,
+                              const Color32 &color, bool colorCodes);
+      void build(CacheEntry &ce, bool load);
+      void rebuild_printed();
+      void release(CacheEntry &ce);
+      void compact_cache();
+      void update_resident();
+      void make_resident(CacheEntry &ce);
+      void defragment_resident();
+      void grow_resident(size_t bytes);
+      void build_resident_draws();
+      void add_instance(const CacheEntry *ce);
       void generate(Vertex *verts, int index, const Glyph &glyph,
                     const int2 &position, Color32 color);
+      int  advance(const Glyph &glyph)  const;
+      int  line_height()                const;
       
       FontFace    *m_face;
+      float       m_scale;    // size in pt / face size, 1 unless SDF.
       int2        m_position;
       int2        m_requestedPosition;
       size_t      m_vertCount;
       uint32_t    m_counter;
       Cache       m_cache;
+      CacheIndex  m_cacheIndex; // entry hash -> m_cache index.
+      Instances   m_printed;    // since the last update_cache().
+      Instances   m_drawn;      // until the last update_cache().
+      std::vector<uint32_t> m_remap; // update_cache() scratch.
+      mutable std::vector<size_t> m_pageFirst; // get_geometry() scratch,
+      mutable std::vector<size_t> m_pageNext;  // kept for their capacity.
+      BlockArena  m_arena;      // verts, pages and text of the entries.
+      MemPool     m_residentPool;     // holds m_resident.vb.
+      Resident    m_resident;
       bool        m_cacheUpdated;
       uint32_t    m_cacheTTL;
+      size_t      m_cacheHits;
+      size_t      m_cacheMisses;
 
       friend class ngl::FontCacheRenderer;
       friend class ngl::FontCacheBatchRenderer;
@@ -110,11 +204,31 @@ namespace ngl{
   */
   //========================================================
   struct Font::CacheEntry{
-    Hash_t      hash;
+    Hash64_t    hash;       // of the key: text, color and colorCodes,
+    const char  *text;      // all checked on a hit.
+    size_t      textLength;
+    Color32     color;      // print() color, white for cprint().
+    bool        colorCodes; // printed by cprint().
     uint32_t    lastUsed;
-    Vertex      *verts;
-    int2        positionDelta;
+    Vertex      *verts;     // relative to where the text is printed.
+    uint32_t    *pages;     // atlas page of each quad.
+    uint32_t    pageMask;   // bit n set if a quad is on page n.
+    uint32_t    epoch;      // FontFace::epoch() when generated.
+    int2        positionDelta;  // pen movement.
     size_t      vertCount;
+    bool        complete;   // false if some glyphs were still loading.
+    uint32_t    block;      // of m_arena holding verts, pages and text,
+    size_t      bytes;      // all in one allocation.
+    Vertex      *resident;  // copy of verts in m_residentPool, or NULL,
+  };                        // its quads ordered by atlas page.
+  //========================================================
+  /** \class Instance
+  \brief  A print of a cache entry.
+  */
+  //========================================================
+  struct Font::Instance{
+    uint32_t    entry;      // index in m_cache.
+    int2        position;   // added to the entry's vertices.
   };
   //========================================================
   /** \class Vertex
@@ -126,6 +240,143 @@ namespace ngl{
     float2    texCoord;
     Color32   color;
   };
+  //========================================================
+  /** \class Batch
+  \brief  Triangles drawn with a single atlas texture.
+
+    The triangles are quad_indices() ones, triangle t of vertex buffer vb
+    being quad_indices()[t] of vb. The indices reach kMaxQuads quads past
+    the vertex pointers; a batch of any length is drawn in chunks of that
+    many, each with its own pointers (AbstractRenderer::draw_quads).
+  */
+  //========================================================
+  struct Font::Batch{
+    TextureID   texID;
+    int         channel;    // of texID to draw, -1 for alpha textures.
+    size_t      firstTri;
+    size_t      triCount;
+  };
+  //========================================================
+  /** \class Draw
+  \brief  Batch of Font::Resident triangles moved by offset.
+  */
+  //========================================================
+  struct Font::Draw{
+    Batch       batch;
+    int2        offset;     // where the text was printed.
+  };
+
+  //--------------------------------------------------------------------------//
+  //{{{ HashTable(size_t capacity)
+  ///   \param[in]  capacity    Initial number of slots, rounded up to a
+  ///                           power of two.
+  //--------------------------------------------------------------------------//
+  template<typename Type>
+  HashTable<Type>::HashTable(size_t capacity)
+  :m_size(0), m_shift(64){
+    size_t slots=1;
+    while( slots < capacity )
+      slots<<=1;
+    rehash(slots);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Type* find(Hash64_t hash)
+  /// \returns
+  ///   Data stored under \a hash, or NULL.
+  //--------------------------------------------------------------------------//
+  template<typename Type>
+  Type* HashTable<Type>::find(Hash64_t hash){
+    size_t i=locate(hash);
+    return ( m_slots[i].used ? &m_slots[i].data : NULL );
+  }
+  template<typename Type>
+  const Type* HashTable<Type>::find(Hash64_t hash) const{
+    size_t i=locate(hash);
+    return ( m_slots[i].used ? &m_slots[i].data : NULL );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Type& insert(Hash64_t hash, const Type &data)
+  /// Stores \a data under \a hash, replacing what was there.
+  //--------------------------------------------------------------------------//
+  template<typename Type>
+  Type& HashTable<Type>::insert(Hash64_t hash, const Type &data){
+    if( (m_size+1)*4 > m_slots.size()*3 )
+      rehash(m_slots.size()*2);
+
+    Slot &slot=m_slots[ locate(hash) ];
+    if( !slot.used ){
+      slot.hash =hash;
+      slot.used =true;
+      ++m_size;
+    }
+    slot.data=data;
+    return slot.data;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool erase(Hash64_t hash)
+  /// Removes \a hash. The entries after it in the probe sequence that
+  /// could sit in the freed slot are moved back, so no tombstone is left.
+  /// \returns
+  ///   false if \a hash was not in the table.
+  //--------------------------------------------------------------------------//
+  template<typename Type>
+  bool HashTable<Type>::erase(Hash64_t hash){
+    const size_t mask=m_slots.size()-1;
+    size_t hole=locate(hash);
+    if( !m_slots[hole].used )
+      return false;
+
+    for(size_t i=(hole+1) & mask; m_slots[i].used; i=(i+1) & mask){
+      // Stays if its home is cyclically in (hole, i].
+      size_t h=home(m_slots[i].hash);
+      if( hole <= i ? (hole < h && h <= i) : (hole < h || h <= i) )
+        continue;
+      m_slots[hole]=m_slots[i];
+      hole=i;
+    }
+    m_slots[hole].used=false;
+    --m_size;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  template<typename Type>
+  void HashTable<Type>::clear(){ //{{{
+    for(size_t i=0; i < m_slots.size(); ++i)
+      m_slots[i].used=false;
+    m_size=0;
+  }
+  //}}}-----------------------------------------------------------------------//
+  template<typename Type>
+  size_t HashTable<Type>::home(Hash64_t hash) const{ //{{{
+    return ( m_shift < 64 ? (hash * 0x9e3779b97f4a7c15ull) >> m_shift : 0 );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t locate(Hash64_t hash) const
+  /// \returns
+  ///   Slot holding \a hash, or the free slot it would go to.
+  //--------------------------------------------------------------------------//
+  template<typename Type>
+  size_t HashTable<Type>::locate(Hash64_t hash) const{
+    const size_t mask=m_slots.size()-1;
+    size_t i=home(hash);
+    while( m_slots[i].used && m_slots[i].hash != hash )
+      i=(i+1) & mask;
+    return i;
+  }
+  //}}}-----------------------------------------------------------------------//
+  template<typename Type>
+  void HashTable<Type>::rehash(size_t capacity){ //{{{
+    std::vector<Slot> old(capacity);  // value initialized, all unused.
+    old.swap(m_slots);
 
+    m_shift=64;
+    for(size_t n=capacity; n > 1; n>>=1)
+      --m_shift;
+    for(size_t i=0; i < old.size(); ++i){
+      if( old[i].used )
+        m_slots[ locate(old[i].hash) ]=old[i];
+    }
+  }
+  //}}}
 }
 #endif/* __FONTS_FONT_HPP__ */
@@ -13,9 +13,14 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #define __FONTS_FONTFACE_HPP__
 
 #include "nFontTypes.hpp"
+#include <deque>
 
 namespace ngl{
-  typedef std::vector<Glyph> Glyphs;
+  struct RasterGlyph;
+  class BakedFont;
+  typedef std::vector<RasterGlyph>  RasterGlyphs;
+  // deque, so references returned by FontFace::get_glyph stay valid.
+  typedef std::deque<Glyph> Glyphs;
 
 
   //===========================================================================
@@ -27,24 +32,50 @@ namespace ngl{
       FontFace(const FontFace &obj);
       FontFace& operator=(const FontFace &obj);
     public:
-      FontFace(const String &face, size_t sizeInPt);
+      FontFace(const String &face, size_t sizeInPt, uint32_t flags=0);
+      FontFace(const BakedFont &font, size_t sizeInPt, uint32_t flags=0);
       virtual ~FontFace();
 
 
       const String  &name()     const;
       size_t        size()      const;
       const uint2   &maxSize()  const;
+      size_t        memory_usage() const;
+      bool          is_sdf()    const;
 
-      size_t        text_width(const String &text);
+      size_t        text_width(const String &text, float scale=1.0f);
       size_t        split(const String &text,
                           size_t width,
                           StringList &lines,
-                          TextWrapMode wrapMode=TextWrap::LineWrap);
-      const Glyph   &get_glyph(char code);
+                          TextWrapMode wrapMode=TextWrap::LineWrap,
+                          float scale=1.0f);
+      const Glyph   &get_glyph(Codepoint code);
+      const Glyph   &find_glyph(Codepoint code) const;
+      size_t        preload(const String &charset, size_t numThreads=0);
+
+      void          set_async(size_t numThreads);
+      size_t        pending()   const;
+      size_t        uploaded()  const;
+      void          update();
+      bool          save_cache();
+
+      void          set_budget(size_t pages);
+      void          touch_pages(uint32_t pageMask);
+      uint32_t      epoch()     const;
+      bool          defragment();
 
       const IGlyphAtlas  *atlas() const  { return m_atlas;   }
     private:
       void load(const String &face, size_t size);
+      const Glyph &load_glyph(Codepoint code);
+      const Glyph &insert_glyph(const RasterGlyph &raster);
+      size_t      insert_glyphs(const RasterGlyphs &rasters);
+      size_t      add_to_atlas(std::vector<AtlasEntry> &entries);
+      bool        add_glyph(Glyph &glyph, const byte *data);
+      bool        evict();
+      bool        apply_layout();
+      void        load_cache();
+      void        add_cached_glyphs();
       struct Pimpl;
 
 
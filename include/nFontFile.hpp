@@ -0,0 +1,37 @@
+//==============================================================================
+/**
+\file            FontFile.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_FONTFILE_HPP__)
+#define __FONTS_FONTFILE_HPP__
+
+#include "nFontTypes.hpp"
+
+namespace ngl{
+  /** Read only memory mappings of font files.
+
+    Every font file is mapped once, no matter how many faces (sizes, worker
+    threads) are opened from it; acquire() and release() keep a reference
+    count per file and the mapping goes away with the last reference.
+    Thread safe.
+   */
+  namespace fontfiles{
+    extern const byte*  acquire(const String &path, size_t &size);
+    extern void         release(const byte *data);
+    extern size_t       count();
+    extern size_t       mapped_bytes();
+
+    extern bool         map_file(const String &path,
+                                 const byte   *&data,
+                                 size_t       &size);
+    extern void         unmap_file(const byte *data, size_t size);
+  }
+}
+#endif/* __FONTS_FONTFILE_HPP__ */
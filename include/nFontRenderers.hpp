@@ -13,6 +13,7 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #define __NGL_FONTRENDERERS_HPP__
 
 #include "nFont.hpp"
+#include <map>
 
 namespace ngl{
 //======================================================================
@@ -30,15 +31,20 @@ class AbstractRenderer{
     AbstractRenderer();
     virtual ~AbstractRenderer();
 
-    int state_setup();
+    int state_setup(const Font &font);
     int state_cleanup();
+    int bind_batch(const Font::Batch &batch);
+    int vertex_pointers(const Font::Vertex *first);
+    int draw_quads(const Font::Vertex *vb, size_t firstTri, size_t triCount,
+                   const void *indices, size_t &base);
 
     void print_info(const Font &font);
     void print_vertex(const Font::Vertex &v);
 
     virtual int render(const Font &font)=0;
 
-  private:
+  protected:
+    Font::Batches   m_batches;  // filled by Font::get_geometry.
 
 };
 //======================================================================
@@ -62,7 +68,6 @@ class AbstractRenderer{
       int extend_buffers(uint32_t vertCount);
       uint32_t      m_vertCount;
       Font::Vertex  *m_vb;
-      Triangle16    *m_ib;
   };
 //======================================================================
 /** \class VARenderer
@@ -80,14 +85,19 @@ class AbstractRenderer{
       virtual int render(const Font &font);
 
     private:
-      static const int  kNumVerts=4096;
-      Font::Vertex      vb[kNumVerts];
-      Triangle16        ib[kNumVerts/2];
+      int extend_buffers(uint32_t vertCount);
+      uint32_t      m_vertCount;
+      Font::Vertex  *m_vb;
   };
 
 //======================================================================
 /** \class VBORenderer
 \brief  Vertex buffer object renderer.
+
+  Mirrors Font::resident() in a vertex buffer, uploading only what changed
+  since the last frame; a static text costs no uploads at all, neither
+  does text that only moves (the modelview matrix moves it). Every font
+  drawn gets its own buffer, kept until forget() or the renderer goes.
 */
 //======================================================================
   class VBORenderer : public AbstractRenderer{
@@ -100,12 +110,24 @@ class AbstractRenderer{
 
       virtual int render(const Font &font);
 
-    private:
-      int extend_buffers(uint32_t vertCount);
+      void forget(const Font &font);
 
-      uint32_t    m_vb;
-      uint32_t    m_ib;
-      uint32_t    m_vertCount;
+      /// Bytes uploaded by the last render().
+      size_t      uploaded() const { return m_uploaded; }
+
+    private:
+      struct Buffer{
+        uint32_t  vb;
+        uint32_t  vertCount;
+        uint32_t  serial;         // of the Font::Resident in vb.
+      };
+      typedef std::map<const Font*, Buffer>   Buffers;
+
+      int upload(Buffer &buffer, const Font::Resident &resident);
+
+      Buffers     m_buffers;
+      uint32_t    m_ib;           // Font::quad_indices(), never changes.
+      size_t      m_uploaded;
   };
 
 
@@ -16,13 +16,15 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #include <cstring>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
 #include <stdint.h>
 
 #ifdef N_DEBUG_GL
-#  define GL_DBG(FUNC)                    \
-      FUNC;                               \
-      if( err=gl_error_check(#FUNC) )     \
-        return err;
+#  define GL_DBG(FUNC)                          \
+      FUNC;                                     \
+      if( Error glErr=gl_error_check(#FUNC) )   \
+        return glErr;
 #else
 #  define GL_DBG(FUNC) FUNC;
 #endif
@@ -45,16 +47,67 @@ namespace ngl{
   typedef int32_t               Error;
   typedef std::vector<String>   StringVector;
   typedef std::list<String>     StringList;
-  typedef uint32_t              Hash_t;
+  typedef uint64_t              Hash64_t;
+  typedef uint32_t              Codepoint;    ///< Unicode code point.
 
-  const size_t  kInvalidIndex     = 0xffffffff;
+  const size_t    kInvalidIndex     = 0xffffffff;
+  const Codepoint kMaxCodepoint     = 0x10ffff;
+  const Codepoint kReplacementChar  = 0xfffd;
   const Error   EOk               = 0;
   const Error   ENotEnoughMemory  =-1;
 
   Hash_t gen_hash(const byte* data, size_t size, Hash_t initial=0);
   Hash_t gen_hash(const String &string, Hash_t initial=0);
+  Hash64_t gen_hash64(const void *data, size_t size, Hash64_t seed=0);
   extern Error gl_error_check(const char *msg);
 
+  //----------------------------------------------------------------------------
+  /// Decodes a single UTF-8 sequence and advances \a str past it.
+  ///   \param[in,out]  str   Current position, must be < end.
+  ///   \param[in]      end   End of the string.
+  /// \returns
+  ///   The decoded code point, or kReplacementChar for malformed input (in
+  ///   which case only a single byte is consumed).
+  //----------------------------------------------------------------------------
+  inline Codepoint utf8_decode(const char *&str, const char *end){
+    static const Codepoint kMinValue[]={ 0, 0, 0x80, 0x800, 0x10000 };
+
+    const byte  *s  =reinterpret_cast<const byte*>(str);
+    Codepoint   cp  =s[0];
+    size_t      len;
+    if( cp < 0x80 ){
+      ++str;
+      return cp;
+    }
+    else if( (cp & 0xe0) == 0xc0 ){ len=2; cp&=0x1f; }
+    else if( (cp & 0xf0) == 0xe0 ){ len=3; cp&=0x0f; }
+    else if( (cp & 0xf8) == 0xf0 ){ len=4; cp&=0x07; }
+    else{
+      ++str;
+      return kReplacementChar;
+    }
+
+    if( static_cast<size_t>(end-str) < len ){
+      ++str;
+      return kReplacementChar;
+    }
+    for(size_t i=1; i < len; ++i){
+      if( (s[i] & 0xc0) != 0x80 ){
+        ++str;
+        return kReplacementChar;
+      }
+      cp=(cp << 6) | (s[i] & 0x3f);
+    }
+    // Overlong encodings, surrogates and values past the unicode range.
+    if( cp < kMinValue[len] || cp > kMaxCodepoint ||
+        (cp >= 0xd800 && cp <= 0xdfff) ){
+      ++str;
+      return kReplacementChar;
+    }
+    str+=len;
+    return cp;
+  }
+
 
   namespace TextWrap{
     enum Mode{
@@ -65,6 +118,17 @@ namespace ngl{
   }
   typedef TextWrap::Mode TextWrapMode;
 
+  namespace FaceFlags{
+    enum Flag{
+      None  =0,
+      Async     =1 << 0,  // Glyphs are loaded in the background.
+      SDF       =1 << 1,  // Distance field glyphs, see sdf::kReferenceSize.
+      Headless  =1 << 2,  // Glyphs are kept in a MemoryGlyphAtlas, no GL.
+      Shared    =1 << 3   // Glyphs go to one channel of an RGBA atlas
+                          // shared with up to 3 other faces.
+    };
+  }
+
   //============================================================================
   //{{{ Color32
   /** 32bit color.
@@ -290,34 +354,149 @@ namespace ngl{
   */
   //============================================================================
   struct Glyph{
-    char          code;     // character.
+    Codepoint     code;     // character.
     TexCoords     botLeft;
     TexCoords     topRight;
     Size2         size;
     int2          off;
     float         advance;  // glyph x advance.
     IGlyphAtlas   *owner;
+    uint32_t      page;     // atlas texture the glyph is in.
 
     bool operator!=(const Glyph &obj) const;
     bool operator==(const Glyph &obj) const;
 
     static const Glyph null;
+    static const Glyph pending;   ///< Still being loaded in the background.
+  };//}}}
+
+  //============================================================================
+  //{{{ AtlasEntry
+  /** Single glyph bitmap of an IGlyphAtlas::add_batch call.
+   */
+  //============================================================================
+  struct AtlasEntry{
+    Glyph         *glyph;   // receives owner and texture coordinates.
+    const byte    *data;
+    Size2         size;
+  };//}}}
+
+  //============================================================================
+  //{{{ AtlasTransfer
+  /** Move of a single glyph rectangle, when the atlas is repacked.
+   */
+  //============================================================================
+  struct AtlasTransfer{
+    Glyph         *glyph;   // receives the new page and texture coordinates.
+    Size2         size;
+    uint32_t      srcPage;
+    uint2         src;
+    uint32_t      dstPage;
+    uint2         dst;
+  };//}}}
+  struct AtlasLayout;
+
+  //============================================================================
+  //{{{ NodeRecycler
+  /** Free list for the nodes of one node based container (std::map,
+    std::set), see RecyclingAllocator. Once the container has been as big
+    as it gets, inserting and erasing does not touch the heap. The nodes
+    are returned to the heap with the recycler, which has to outlive its
+    container.
+   */
+  //============================================================================
+  class NodeRecycler{
+      NodeRecycler(const NodeRecycler &obj)             = delete;
+      NodeRecycler& operator=(const NodeRecycler &obj)  = delete;
+    public:
+      NodeRecycler() :m_free(NULL) {}
+      ~NodeRecycler(){
+        while( m_free ){
+          Node *node=m_free;
+          m_free=node->next;
+          ::operator delete(node);
+        }
+      }
+
+      void* alloc(size_t size){
+        if( !m_free )
+          return ::operator new( size > sizeof(Node) ? size : sizeof(Node) );
+        Node *node=m_free;
+        m_free=node->next;
+        return node;
+      }
+      void free(void *mem){
+        Node *node=static_cast<Node*>(mem);
+        node->next=m_free;
+        m_free=node;
+      }
+
+    private:
+      struct Node{
+        Node  *next;
+      };
+      Node    *m_free;
+  };//}}}
+
+  //============================================================================
+  //{{{ RecyclingAllocator
+  /** Allocator taking single objects from a NodeRecycler, arrays (and
+    everything, without a recycler) from the heap.
+   */
+  //============================================================================
+  template<typename T>
+  struct RecyclingAllocator{
+    typedef T   value_type;
+
+    RecyclingAllocator(NodeRecycler *recycler=NULL) :recycler(recycler) {}
+    template<typename U>
+    RecyclingAllocator(const RecyclingAllocator<U> &obj)
+    :recycler(obj.recycler) {}
+
+    T* allocate(size_t n){
+      if( n == 1 && recycler )
+        return static_cast<T*>( recycler->alloc(sizeof(T)) );
+      return static_cast<T*>( ::operator new(n*sizeof(T)) );
+    }
+    void deallocate(T *mem, size_t n){
+      if( n == 1 && recycler )
+        recycler->free(mem);
+      else
+        ::operator delete(mem);
+    }
+
+    template<typename U>
+    bool operator==(const RecyclingAllocator<U> &obj) const{
+      return recycler == obj.recycler;
+    }
+    template<typename U>
+    bool operator!=(const RecyclingAllocator<U> &obj) const{
+      return recycler != obj.recycler;
+    }
+
+    NodeRecycler  *recycler;
   };//}}}
 
   //============================================================================
   //{{{ MemPool
   /** Memory pool (freelist).
+
+    Sub-allocates one block of memory. The free chunks are indexed twice:
+    by offset, to merge a freed chunk with its free neighbours, and by size,
+    so alloc() takes the smallest chunk that fits (best fit) in O(log n).
+    Sizes are rounded up to kAlignment.
+
+    defragment() slides the allocations to the front, leaving a single free
+    chunk at the end, and reports every move so the owner can update its
+    pointers (and whatever mirrors the pool, e.g. a buffer object).
    */
   //============================================================================
   class MemPool{
       MemPool(const MemPool &obj);
       MemPool& operator=(const MemPool &obj);
-      struct MemBlock{
-        size_t    prevFree;
-        size_t    prev;
-        size_t    next;
-      };
     public:
+      static const size_t kAlignment=8;
+
       MemPool();
       virtual ~MemPool();
 
@@ -331,16 +510,33 @@ namespace ngl{
       const byte*   data()      const;
       size_t        size()      const;
       size_t        available() const;
+      size_t        largest()   const;
 
     private:
-      typedef std::list<Chunk>    FreeList;
-
-      FreeList::iterator prev_free(MemAddr_t addr);
-
-      byte      *m_data;
-      size_t    m_size;
-      size_t    m_available;
-      FreeList  m_free;
+      struct BySize{
+        bool operator()(const Chunk &ls, const Chunk &rs) const{
+          return ls.size < rs.size || ( ls.size == rs.size && ls.off < rs.off );
+        }
+      };
+      typedef std::pair<const size_t, size_t>   ChunkMapValue;
+      typedef std::map< size_t, size_t, std::less<size_t>,
+                        RecyclingAllocator<ChunkMapValue> >
+                                                ChunkMap;   // offset -> size.
+      typedef std::set< Chunk, BySize, RecyclingAllocator<Chunk> >
+                                                FreeIndex;
+
+      void add_free(size_t off, size_t size);
+      void remove_free(ChunkMap::iterator chunk);
+
+      byte          *m_data;
+      size_t        m_size;
+      size_t        m_available;
+      NodeRecycler  m_freeNodes;      // before the containers using them.
+      NodeRecycler  m_freeBySizeNodes;
+      NodeRecycler  m_usedNodes;
+      ChunkMap      m_free;
+      FreeIndex     m_freeBySize;
+      ChunkMap      m_used;
   };//}}}
 
 
@@ -358,10 +554,89 @@ namespace ngl{
     IGlyphAtlas(){}
     virtual ~IGlyphAtlas(){}
 
-    virtual TextureID texid() const = 0;
+    virtual TextureID     texid(size_t page=0) const = 0;
+    virtual const Size2&  size()  const = 0;   ///< Of a page, in texels.
+    /// Number of textures the glyphs are spread over, see Glyph::page.
+    virtual size_t        pages() const { return 1; }
+    /// Channel of the RGBA textures the glyphs are in, -1 if the textures
+    /// hold nothing but alpha.
+    virtual int           channel() const { return -1; }
     virtual Error add(Glyph &out, const byte *data, const Size2 &size)=0;
+
+    /// Reserves room for a \a size bitmap, which the caller then writes
+    /// (rows bottom-up, \a pitch bytes apart) straight into the atlas
+    /// memory. Only staging atlases support it, the default returns NULL
+    /// and the caller has to use add().
+    /// \returns
+    ///   Where the bitmap goes, or NULL.
+    virtual byte* reserve(Glyph &/*out*/, const Size2 &/*size*/,
+                          size_t &/*pitch*/){
+      return NULL;
+    }
+    /// Uploads everything added since the last call. Staging atlases defer
+    /// the texture updates to here, call it once per frame before drawing.
+    virtual Error flush(){
+      return EOk;
+    }
+    /// Bytes sent to the GPU by all flush() calls so far, 0 for atlases
+    /// that never upload anything. See FontFace::uploaded() for a frame.
+    virtual size_t uploaded() const{
+      return 0;
+    }
+
+    /// Limits the atlas to \a pages textures (0 for no limit), add() fails
+    /// once they are all full. Pages that already exist are kept.
+    virtual void set_page_limit(size_t /*pages*/){
+    }
+    /// Drops all glyphs of \a page, its space is reused by the following
+    /// add() calls. Glyphs that were on it must not be drawn any more.
+    /// \returns
+    ///   false if the atlas can not free space.
+    virtual bool clear_page(size_t /*page*/){
+      return false;
+    }
+    /// Moves the glyphs to the places planned by an AtlasRepacker, all at
+    /// once, and updates them. The pages become the ones of \a layout.
+    /// \returns
+    ///   false if the atlas can not be repacked.
+    virtual bool repack(const AtlasLayout &/*layout*/){
+      return false;
+    }
+
+    /// Adds several glyphs at once. Implementations should pack and upload
+    /// them in one go, the default just calls add() for each entry.
+    /// Entries that could not be added get a NULL Glyph::owner, the rest
+    /// are still added.
+    /// \returns
+    ///   EOk, or the error of the first entry that could not be added.
+    virtual Error add_batch(AtlasEntry *entries, size_t count){
+      Error ret=EOk;
+      for(size_t i=0; i < count; ++i){
+        Error err=add(*entries[i].glyph, entries[i].data, entries[i].size);
+        if( err ){
+          entries[i].glyph->owner=NULL;
+          if( !ret )
+            ret=err;
+        }
+      }
+      return ret;
+    }
   };//}}}
 
+  namespace Atlas{
+    enum AtlasType{
+      GL,       // GLGlyphAtlas, needs a GL context.
+      Memory,   // MemoryGlyphAtlas, works without one.
+      Channel   // ChannelGlyphAtlas if the GL has texture swizzling, GL
+                // otherwise.
+    };
+  }
+  using Atlas::AtlasType;
+  extern IGlyphAtlas *create_atlas(AtlasType  type,
+                                   size_t     width,
+                                   size_t     height,
+                                   bool       linear=false);
+
 
   namespace freetype{
     extern bool init();
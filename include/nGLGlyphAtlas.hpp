@@ -1,30 +1,52 @@
 #ifndef __NOVO_GLGLYPHATLAS_HPP__
 #define __NOVO_GLGLYPHATLAS_HPP__
 #include "nFontTypes.hpp"
+#include "nMemoryGlyphAtlas.hpp"
+#include <vector>
 
 namespace ngl{
   //============================================================================
   //{{{ GLGLGlyphAtlas
-  /** Glyph Atlas 
+  /** Glyph Atlas
+
+    Glyphs are written to a CPU copy of the texture (see MemoryGlyphAtlas,
+    which also does the packing), and only the part that changed (the
+    bounding box of all new glyphs) is uploaded by flush(), in a single
+    glTexSubImage2D per page. Every page is a texture of its own.
+
+    Once init_extensions() has found buffer objects, the uploads go
+    through a ring of kUploadBuffers pixel buffers, so glTexSubImage2D
+    returns without waiting for the driver to copy client memory. A fence
+    is put after every upload; a buffer the GPU is still reading from is
+    orphaned (given new storage) rather than waited for.
   */
   //============================================================================
-  class GLGlyphAtlas: public IGlyphAtlas{
+  class GLGlyphAtlas: public MemoryGlyphAtlas{
       GLGlyphAtlas(const GLGlyphAtlas &obj);
       GLGlyphAtlas& operator=(const GLGlyphAtlas &obj);
     public:
-      GLGlyphAtlas(size_t width, size_t height);
+      static const size_t kUploadBuffers=4;
+
+      GLGlyphAtlas(size_t width, size_t height, bool linear=false);
       virtual ~GLGlyphAtlas();
 
-      Error add(Glyph &out, const byte *data, const Size2 &size);
+      Error         flush();
+      size_t        uploaded() const            { return m_uploaded; }
+      TextureID     texid(size_t page=0) const;
+
+    protected:
+      void  page_added(size_t page);
+      void  page_removed(size_t page);
 
-      TextureID texid() const   { return m_texture; }
     private:
-      Error init_atlas(size_t width, size_t height);
+      struct UploadRing;
+
+      Error upload(size_t page);
 
-      TextureID     m_texture;
-      Size2         m_size;
-      uint2         m_freeOff;
-      size_t        m_currRowHeight;
+      std::vector<TextureID>  m_textures;
+      UploadRing              *m_ring;
+      size_t                  m_uploaded;   // bytes, by all flush() calls.
+      bool                    m_linear;
   };//}}}
 }
 
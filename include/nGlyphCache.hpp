@@ -0,0 +1,171 @@
+//==============================================================================
+/**
+\file            GlyphCache.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_GLYPHCACHE_HPP__)
+#define __FONTS_GLYPHCACHE_HPP__
+
+#include "nFontTypes.hpp"
+
+namespace ngl{
+  //============================================================================
+  //{{{ GlyphCacheKey
+  /** Everything the rasterized glyphs depend on. A cache file is only used
+      if its key matches exactly.
+   */
+  //============================================================================
+  struct GlyphCacheKey{
+    uint64_t    fontHash;   ///< Hash of the font file contents.
+    uint64_t    fontSize;   ///< Font file size in bytes.
+    uint32_t    pointSize;
+    uint32_t    dpi;
+    uint32_t    loadFlags;  ///< FreeType load flags.
+    uint32_t    sdfSpread;  ///< Distance field spread, 0 for plain bitmaps.
+
+    bool operator==(const GlyphCacheKey &obj) const;
+    bool operator!=(const GlyphCacheKey &obj) const { return !(*this==obj); }
+  };//}}}
+
+  //============================================================================
+  //{{{ GlyphCache
+  /** Read only, memory mapped glyph cache file.
+
+    Layout (native endianness, everything 8 byte aligned):
+      Header
+      Record[header.glyphCount]
+      bitmaps, each Record::width*Record::height bytes at Record::dataOffset
+      (relative to the Header), rows bottom-up like RasterGlyph.
+
+    The same image is embedded, once per size, in BakedFont files; attach()
+    gives a view of such an image without owning the memory.
+   */
+  //============================================================================
+  class GlyphCache{
+      GlyphCache(const GlyphCache &obj)             = delete;
+      GlyphCache& operator=(const GlyphCache &obj)  = delete;
+    public:
+      static const uint32_t kMagic    =0x434c474e;   // "NGLC"
+      static const uint32_t kVersion  =1;
+
+      struct Header{
+        uint32_t        magic;
+        uint32_t        version;
+        GlyphCacheKey   key;
+        uint32_t        glyphCount;
+        uint32_t        reserved;
+      };
+      struct Record{
+        Codepoint       code;
+        uint32_t        width;
+        uint32_t        height;
+        int32_t         offX;
+        int32_t         offY;
+        float           advance;
+        uint64_t        dataOffset;
+      };
+
+      GlyphCache();
+      ~GlyphCache();
+
+      bool            open(const String &path, const GlyphCacheKey &key);
+      bool            attach(const byte *data, size_t size);
+      void            close();
+
+      bool            is_open()   const { return m_data != NULL;  }
+      size_t          size()      const;
+      const Record    &record(size_t index) const;
+      const byte      *bitmap(const Record &rec) const;
+
+      const GlyphCacheKey &key() const;
+
+      static void     serialize(const GlyphCacheKey             &key,
+                                const std::vector<Record>       &records,
+                                const std::vector<const byte*>  &bitmaps,
+                                std::vector<byte>               &out);
+      static bool     write(const String                    &path,
+                            const GlyphCacheKey             &key,
+                            const std::vector<Record>       &records,
+                            const std::vector<const byte*>  &bitmaps);
+
+    private:
+      bool            validate(const String &name);
+
+      const byte      *m_data;
+      size_t          m_size;
+      bool            m_mapped;
+  };//}}}
+
+  //============================================================================
+  //{{{ BakedFont
+  /** Font pre-rendered by nfonts_bake: glyph cache images for a list of
+      sizes in one memory mapped file. Faces created from it (see
+      FontFace::FontFace(const BakedFont&, size_t)) never touch FreeType.
+
+    Layout:
+      Header
+      Face[header.faceCount]
+      GlyphCache images, at Face::offset (8 byte aligned).
+   */
+  //============================================================================
+  class BakedFont{
+      BakedFont(const BakedFont &obj)             = delete;
+      BakedFont& operator=(const BakedFont &obj)  = delete;
+    public:
+      static const uint32_t kMagic    =0x424c474e;   // "NGLB"
+      static const uint32_t kVersion  =1;
+
+      struct Header{
+        uint32_t        magic;
+        uint32_t        version;
+        uint32_t        faceCount;
+        uint32_t        reserved;
+      };
+      struct Face{
+        uint32_t        pointSize;
+        uint32_t        maxWidth;     ///< FontFace::maxSize()
+        uint32_t        maxHeight;
+        uint32_t        reserved;
+        uint64_t        offset;
+        uint64_t        size;
+      };
+
+      BakedFont();
+      explicit BakedFont(const String &path);
+      ~BakedFont();
+
+      bool            open(const String &path);
+      void            close();
+
+      bool            is_open()   const { return m_data != NULL;  }
+      const String    &name()     const { return m_name;          }
+      size_t          faces()     const;
+      const Face      *find(size_t pointSize) const;
+      const byte      *image(const Face &face) const;
+
+      static bool     write(const String                          &path,
+                            const std::vector<Face>               &faces,
+                            const std::vector< std::vector<byte> > &images);
+
+    private:
+      String          m_name;
+      const byte      *m_data;
+      size_t          m_size;
+  };//}}}
+
+  namespace glyphcache{
+    extern void           set_directory(const String &dir);
+    extern const String&  directory();
+    extern bool           enabled();
+    extern String         file_name(const String &face,
+                                    const GlyphCacheKey &key);
+    extern bool           hash_file(const String &path, GlyphCacheKey &key);
+  }
+}
+#endif/* __FONTS_GLYPHCACHE_HPP__ */
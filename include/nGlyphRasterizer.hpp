@@ -0,0 +1,68 @@
+//==============================================================================
+/**
+\file            GlyphRasterizer.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_GLYPHRASTERIZER_HPP__)
+#define __FONTS_GLYPHRASTERIZER_HPP__
+
+#include "nFontTypes.hpp"
+
+namespace ngl{
+  //============================================================================
+  //{{{ RasterGlyph
+  /** Glyph bitmap and metrics, as produced by FreeType.
+
+    Rows are tightly packed and already flipped bottom-up, ready to be added
+    to an IGlyphAtlas. \a loaded is false when FreeType failed to load the
+    character.
+   */
+  //============================================================================
+  struct RasterGlyph{
+    Codepoint           code;
+    bool                loaded;
+    Size2               size;
+    int2                off;
+    float               advance;
+    std::vector<byte>   pixels;
+  };//}}}
+  typedef std::vector<RasterGlyph>  RasterGlyphs;
+
+  //============================================================================
+  //{{{ GlyphRasterizer
+  /** Pool of worker threads rasterizing glyphs in the background.
+
+    Every worker opens its own FreeType library and face, so requests never
+    touch the FT_Face owned by FontFace. Finished glyphs are picked up with
+    collect(), which is meant to be called from the GL thread. With a non
+    zero sdfSpread the workers also turn the glyphs into distance fields.
+   */
+  //============================================================================
+  class GlyphRasterizer{
+      GlyphRasterizer(const GlyphRasterizer &obj)             = delete;
+      GlyphRasterizer& operator=(const GlyphRasterizer &obj)  = delete;
+    public:
+      GlyphRasterizer(const String  &face,
+                      size_t        sizeInPt,
+                      size_t        numThreads,
+                      size_t        sdfSpread=0);
+      ~GlyphRasterizer();
+
+      void    request(Codepoint code);
+      void    wait();
+      size_t  collect(RasterGlyphs &out);
+      size_t  pending()   const;
+      size_t  threads()   const;
+
+    private:
+      struct Pimpl;
+      Pimpl   *d;
+  };//}}}
+}
+#endif/* __FONTS_GLYPHRASTERIZER_HPP__ */
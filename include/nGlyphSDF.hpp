@@ -0,0 +1,33 @@
+//==============================================================================
+/**
+\file            GlyphSDF.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_GLYPHSDF_HPP__)
+#define __FONTS_GLYPHSDF_HPP__
+
+#include "nGlyphRasterizer.hpp"
+
+namespace ngl{
+  /** Signed distance field glyphs.
+
+    SDF faces are rasterized once, at kReferenceSize, and the bitmaps turned
+    into distance fields: 128 is the glyph outline, values go up inside and
+    down outside, reaching 255/0 at kSpread pixels from it. Sampled with
+    linear filtering and alpha tested at 0.5, such a bitmap gives sharp
+    edges at any scale, so one atlas serves every size of the face.
+   */
+  namespace sdf{
+    const size_t  kReferenceSize  =32;  ///< pt, size SDF faces are loaded at.
+    const size_t  kSpread         =6;   ///< pixels, at kReferenceSize.
+
+    extern void   generate(RasterGlyph &glyph, size_t spread=kSpread);
+  }
+}
+#endif/* __FONTS_GLYPHSDF_HPP__ */
@@ -0,0 +1,66 @@
+//==============================================================================
+/**
+\file            GlyphTable.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_GLYPHTABLE_HPP__)
+#define __FONTS_GLYPHTABLE_HPP__
+
+#include "nFontTypes.hpp"
+
+namespace ngl{
+  //============================================================================
+  //{{{ GlyphTable
+  /** Maps code points to loaded glyphs.
+
+    Two level paged table: the high bits of a code point select a page, the
+    low kPageBits index into it. Pages are allocated on first insert, so a
+    face with a handful of scripts only pays for the pages it touches, and
+    every lookup is two loads no matter how many glyphs are loaded.
+    The table does not own the glyphs, the pointers have to stay valid for
+    as long as they are in the table.
+   */
+  //============================================================================
+  class GlyphTable{
+      GlyphTable(const GlyphTable &obj)             = delete;
+      GlyphTable& operator=(const GlyphTable &obj)  = delete;
+    public:
+      static const size_t kPageBits =8;
+      static const size_t kPageSize =1 << kPageBits;
+      static const size_t kPageMask =kPageSize-1;
+      static const size_t kNumPages =(kMaxCodepoint >> kPageBits) + 1;
+
+      GlyphTable();
+      ~GlyphTable();
+
+      inline Glyph* find(Codepoint code) const;
+      void          insert(Codepoint code, Glyph *glyph);
+      void          clear();
+      size_t        size()  const { return m_size;  }
+      size_t        pages() const { return m_pages; }
+
+    private:
+      typedef Glyph*  Page[kPageSize];
+
+      Page        *m_table[kNumPages];
+      size_t      m_size;
+      size_t      m_pages;
+  };
+  //--------------------------------------------------------------------------//
+  Glyph* GlyphTable::find(Codepoint code) const{ //{{{
+    if( code > kMaxCodepoint )
+      return NULL;
+
+    const Page *page=m_table[code >> kPageBits];
+    return (page ? (*page)[code & kPageMask] : NULL);
+  }
+  //}}}
+  //}}}
+}
+#endif/* __FONTS_GLYPHTABLE_HPP__ */
@@ -0,0 +1,80 @@
+#ifndef __NOVO_MEMORYGLYPHATLAS_HPP__
+#define __NOVO_MEMORYGLYPHATLAS_HPP__
+#include "nFontTypes.hpp"
+#include "nSkylinePacker.hpp"
+#include <vector>
+
+namespace ngl{
+  //============================================================================
+  //{{{ MemoryGlyphAtlas
+  /** Glyph atlas kept in memory only.
+
+    Works without any GL context (text layout on headless machines, tools,
+    benchmarks), texid() is always 0. The glyph bitmaps can be read back
+    with pixels().
+
+    Glyphs are packed with a SkylinePacker into pages of the given size.
+    When a glyph does not fit any more, another page is allocated, up to
+    kMaxPages or the limit set by set_page_limit(). Glyph::page says which
+    page a glyph is in. Space is only ever freed a whole page at a time, by
+    clear_page().
+
+    GLGlyphAtlas builds on this class, so both pack glyphs and report
+    occupancy the same way.
+  */
+  //============================================================================
+  class MemoryGlyphAtlas: public IGlyphAtlas{
+      MemoryGlyphAtlas(const MemoryGlyphAtlas &obj);
+      MemoryGlyphAtlas& operator=(const MemoryGlyphAtlas &obj);
+    public:
+      static const size_t kMaxPages=16;
+
+      MemoryGlyphAtlas(size_t width, size_t height);
+      virtual ~MemoryGlyphAtlas();
+
+      Error add(Glyph &out, const byte *data, const Size2 &size);
+      byte* reserve(Glyph &out, const Size2 &size, size_t &pitch);
+      Error flush();
+      void  set_page_limit(size_t pages);
+      bool  clear_page(size_t page);
+      bool  repack(const AtlasLayout &layout);
+
+      TextureID     texid(size_t /*page*/=0) const { return 0;           }
+      size_t        pages() const               { return m_pages.size(); }
+      const Size2&  size()  const               { return m_size;         }
+      const byte*   pixels(size_t page) const;
+
+      float         occupancy() const;
+      size_t        waste()     const;
+
+    protected:
+      struct Region{
+        uint2   min;
+        uint2   max;
+      };
+      struct Page{
+        SkylinePacker     packer;
+        std::vector<byte> pixels;   // rows bottom-up, size().width apart.
+        Region            dirty;    // changed since the last flush(), empty
+                                    // if min == max.
+      };
+
+      /// Called for every new page, including the first one (which is
+      /// created by the constructor, before derived classes exist).
+      virtual void  page_added(size_t /*page*/)   {}
+      /// Called for the last page, before it is removed by repack().
+      virtual void  page_removed(size_t /*page*/) {}
+
+      Page  *add_page();
+      void  set_texcoords(Glyph &out, size_t page, const uint2 &off,
+                          const Size2 &size);
+      void  mark_dirty(Page &page, const uint2 &off, const Size2 &size);
+
+      std::vector<Page*>  m_pages;
+      Size2               m_size;     // of every page.
+      size_t              m_maxPages;
+      size_t              m_current;  // page reserve() tries first.
+  };//}}}
+}
+
+#endif/* __NOVO_MEMORYGLYPHATLAS_HPP__ */
@@ -0,0 +1,58 @@
+//==============================================================================
+/**
+\file            SkylinePacker.hpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#if !defined(__FONTS_SKYLINEPACKER_HPP__)
+#define __FONTS_SKYLINEPACKER_HPP__
+
+#include "nFontTypes.hpp"
+#include <vector>
+
+namespace ngl{
+  //============================================================================
+  //{{{ SkylinePacker
+  /** Rectangle packer for glyph atlases (skyline, bottom-left).
+
+    The used part of the texture is described by its top outline, a list of
+    horizontal segments. A rectangle goes where its top edge ends up lowest,
+    resting on the segments under it; short glyphs next to tall ones fill
+    the space a shelf packer would leave empty. The gaps left under a
+    rectangle that rests on uneven segments can not be used any more, and
+    are reported by waste().
+   */
+  //============================================================================
+  class SkylinePacker{
+    public:
+      SkylinePacker();
+      SkylinePacker(size_t width, size_t height);
+
+      void    init(size_t width, size_t height);
+      void    clear();
+      bool    pack(const Size2 &size, uint2 &off);
+
+      size_t  used()        const { return m_used;    }
+      size_t  waste()       const { return m_waste;   }
+      float   occupancy()   const;
+
+    private:
+      struct Node{
+        uint32_t    x;
+        uint32_t    y;
+        uint32_t    width;
+      };
+      bool    fit(size_t index, const Size2 &size, uint32_t &y) const;
+
+      std::vector<Node>   m_skyline;
+      Size2               m_size;
+      size_t              m_used;   // texels covered by packed rectangles.
+      size_t              m_waste;  // texels lost under packed rectangles.
+  };//}}}
+}
+#endif/* __FONTS_SKYLINEPACKER_HPP__ */
@@ -0,0 +1,184 @@
+//======================================================================
+/**
+\file            bake.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+  nfonts_bake - renders a font at a list of sizes into a BakedFont file,
+  which FontFace can load without FreeType.
+
+  usage: nfonts_bake <font> <output> <size[,size...]> [charset | @file]
+
+  The charset is UTF-8, printable ASCII by default. With @file it is read
+  from the given file.
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//======================================================================
+#include "nFontFace.hpp"
+#include "nGlyphRasterizer.hpp"
+#include "nGlyphCache.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ngl{
+  namespace freetype{
+    const FT_Library& handle();
+    bool open_face(FT_Library lib, const String &face, size_t size,
+                   FT_Face &out);
+    bool rasterize(FT_Face face, Codepoint code, RasterGlyph &out);
+    uint2 max_size(FT_Face face);
+  }
+}
+using namespace ngl;
+
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int usage(){
+  fprintf(stderr,
+          "usage: nfonts_bake <font> <output> <size[,size...]> "
+          "[charset | @file]\n");
+  return 1;
+}
+//--------------------------------------------------------------------//
+/// Reads the charset argument, "@path" reads the file at path.
+//--------------------------------------------------------------------//
+bool read_charset(const char *arg, String &out){
+  if( arg[0] != '@' ){
+    out=arg;
+    return true;
+  }
+
+  FILE *file=fopen(arg+1, "rb");
+  if( !file ){
+    fprintf(stderr, "Failed to open charset file %s.\n", arg+1);
+    return false;
+  }
+  char    buffer[4096];
+  size_t  read;
+  while( (read=fread(buffer, 1, sizeof(buffer), file)) > 0 )
+    out.append(buffer, read);
+  fclose(file);
+  return true;
+}
+//--------------------------------------------------------------------//
+/// Rasterizes \a codes at \a size and serializes them as a glyph cache
+/// image, in code point order.
+//--------------------------------------------------------------------//
+bool bake_face(const String                 &font,
+               size_t                       size,
+               const std::vector<Codepoint> &codes,
+               GlyphCacheKey                key,
+               BakedFont::Face              &face,
+               std::vector<byte>            &image){
+  FT_Face ftFace;
+  if( !freetype::open_face(freetype::handle(), font, size, ftFace) )
+    return false;
+
+  RasterGlyphs                    glyphs(codes.size());
+  std::vector<GlyphCache::Record> records;
+  std::vector<const byte*>        bitmaps;
+  for(size_t i=0; i < codes.size(); ++i){
+    if( !freetype::rasterize(ftFace, codes[i], glyphs[i]) )
+      continue;
+
+    GlyphCache::Record rec;
+    rec.code        =glyphs[i].code;
+    rec.width       =glyphs[i].size.width;
+    rec.height      =glyphs[i].size.height;
+    rec.offX        =glyphs[i].off.x;
+    rec.offY        =glyphs[i].off.y;
+    rec.advance     =glyphs[i].advance;
+    rec.dataOffset  =0;
+    records.push_back(rec);
+    bitmaps.push_back(glyphs[i].pixels.data());
+  }
+
+  uint2 maxSize=freetype::max_size(ftFace);
+  FT_Done_Face(ftFace);
+
+  memset(&face, 0, sizeof(face));
+  face.pointSize  =size;
+  face.maxWidth   =maxSize.width;
+  face.maxHeight  =maxSize.height;
+
+  key.pointSize   =size;
+  GlyphCache::serialize(key, records, bitmaps, image);
+
+  printf("  %3upt: %u glyphs, %u bytes\n",
+         (unsigned)size, (unsigned)records.size(), (unsigned)image.size());
+  return true;
+}
+//--------------------------------------------------------------------//
+//--------------------------------------------------------------------//
+int main(int argc, char **argv){
+  if( argc < 4 )
+    return usage();
+
+  const String  font  =argv[1];
+  const String  output=argv[2];
+
+  std::vector<size_t> sizes;
+  for(const char *s=argv[3]; *s; ){
+    char    *end;
+    long    size=strtol(s, &end, 10);
+    if( end == s || size <= 0 )
+      return usage();
+    sizes.push_back(size);
+    s=( *end == ',' ? end+1 : end );
+  }
+
+  String charset;
+  if( argc > 4 ){
+    if( !read_charset(argv[4], charset) )
+      return 1;
+  }
+  else{
+    for(char c=' '; c <= '~'; ++c)
+      charset+=c;
+  }
+
+  std::vector<Codepoint> codes;
+  const char *str=charset.c_str();
+  const char *end=str+charset.length();
+  while( str < end ){
+    Codepoint code=utf8_decode(str, end);
+    if( code >= ' ' || code == '\t' )
+      codes.push_back(code);
+  }
+  std::sort(codes.begin(), codes.end());
+  codes.erase( std::unique(codes.begin(), codes.end()), codes.end() );
+
+  // The images carry the usual cache key, so it is known what they were
+  // made from.
+  GlyphCacheKey key;
+  memset(&key, 0, sizeof(key));
+  if( !glyphcache::hash_file(font, key) ){
+    fprintf(stderr, "Failed to read %s.\n", font.c_str());
+    return 1;
+  }
+
+  if( !freetype::init() )
+    return 1;
+
+  printf("%s: %u glyphs\n", font.c_str(), (unsigned)codes.size());
+  std::vector<BakedFont::Face>      faces(sizes.size());
+  std::vector< std::vector<byte> >  images(sizes.size());
+  bool ok=true;
+  for(size_t i=0; ok && i < sizes.size(); ++i)
+    ok=bake_face(font, sizes[i], codes, key, faces[i], images[i]);
+
+  freetype::cleanup();
+
+  if( !ok || !BakedFont::write(output, faces, images) )
+    return 1;
+
+  printf("wrote %s\n", output.c_str());
+  return 0;
+}
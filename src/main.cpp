@@ -162,16 +162,18 @@ int App::cleanup(){
 int App::tick(){
   glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
-  char cbuff[128]={0};
-  snprintf(cbuff, 128,
+  char cbuff[256]={0};
+  snprintf(cbuff, 256,
             "^3FPS:     ^07%d\n"
             "^3verts/s: ^07%d\n^3tris/s:  ^07%d\n"
-            "^3verts:   ^07%d\n^3tris:    ^07%d\n",
+            "^3verts:   ^07%d\n^3tris:    ^07%d\n"
+            "^3upload:  ^07%d\n",
             frameStats.fps(),
             frameStats.vps(),
             frameStats.tps(),
             frameStats.verts(),
-            frameStats.tris()
+            frameStats.tris(),
+            (int)font->face()->uploaded()
             );
   font->cprint(cbuff);
   font->cprint("^4Testing, ^5one, ^6two, ^7testing\n");
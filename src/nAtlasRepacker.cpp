@@ -0,0 +1,151 @@
+//==============================================================================
+/**
+\file            AtlasRepacker.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nAtlasRepacker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace ngl{
+  struct AtlasRepacker::Pimpl{
+    void run();
+
+    AtlasLayout         layout;
+    std::thread         thread;
+    bool                running;  // started and not collected yet.
+    std::atomic<bool>   done;
+  };
+
+  namespace{
+    //------------------------------------------------------------------------//
+    /// Tallest first, then widest, so short glyphs fill in the steps.
+    //------------------------------------------------------------------------//
+    struct TallerFirst{ //{{{
+      const std::vector<AtlasTransfer> &transfers;
+
+      bool operator()(size_t a, size_t b) const{
+        const Size2 &sa=transfers[a].size;
+        const Size2 &sb=transfers[b].size;
+        if( sa.height != sb.height )
+          return sa.height > sb.height;
+        return sa.width > sb.width;
+      }
+    };//}}}
+  }
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ bool AtlasLayout::add(AtlasTransfer &transfer)
+  /// Packs one more glyph into the layout, adding a page if needed.
+  /// \returns
+  ///   false if it does not fit in maxPages pages.
+  //--------------------------------------------------------------------------//
+  bool AtlasLayout::add(AtlasTransfer &transfer){
+    for(size_t i=0; i < pages.size(); ++i){
+      if( pages[i].pack(transfer.size, transfer.dst) ){
+        transfer.dstPage=i;
+        return true;
+      }
+    }
+    if( pages.size() >= maxPages )
+      return false;
+
+    pages.push_back( SkylinePacker(pageSize.width, pageSize.height) );
+    if( !pages.back().pack(transfer.size, transfer.dst) )
+      return false;
+    transfer.dstPage=pages.size()-1;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  AtlasRepacker::AtlasRepacker() //{{{
+  :d(new Pimpl){
+    d->running  =false;
+    d->done     =false;
+  }
+  //}}}-----------------------------------------------------------------------//
+  AtlasRepacker::~AtlasRepacker(){ //{{{
+    if( d->thread.joinable() )
+      d->thread.join();
+    delete d;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool start(std::vector<AtlasTransfer> &transfers, ...)
+  /// Starts planning a new layout.
+  ///   \param[in]  transfers   Size and current place of every glyph, the
+  ///                           vector is taken over (left empty).
+  ///   \param[in]  pageSize    Size of the atlas pages.
+  ///   \param[in]  maxPages    Number of pages the layout may use.
+  /// \returns
+  ///   false if the previous layout was not collected yet.
+  //--------------------------------------------------------------------------//
+  bool AtlasRepacker::start(std::vector<AtlasTransfer> &transfers,
+                            const Size2 &pageSize, size_t maxPages){
+    if( d->running )
+      return false;
+
+    d->layout.pageSize  =pageSize;
+    d->layout.maxPages  =maxPages;
+    d->layout.pages.clear();
+    d->layout.transfers.swap(transfers);
+    transfers.clear();
+    d->running  =true;
+    d->done     =false;
+    d->thread   =std::thread(&Pimpl::run, d);
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool collect(AtlasLayout &out)
+  /// Picks up the layout, if it is ready. On failure (the glyphs do not fit
+  /// in maxPages pages) \a out has no pages.
+  /// \returns
+  ///   false if nothing was started or the worker is still running.
+  //--------------------------------------------------------------------------//
+  bool AtlasRepacker::collect(AtlasLayout &out){
+    if( !d->running || !d->done )
+      return false;
+
+    d->thread.join();
+    d->running=false;
+    out.pageSize  =d->layout.pageSize;
+    out.maxPages  =d->layout.maxPages;
+    out.transfers.swap(d->layout.transfers);
+    out.pages.swap(d->layout.pages);
+    d->layout.transfers.clear();
+    d->layout.pages.clear();
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  bool AtlasRepacker::busy() const{ //{{{
+    return d->running;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void Pimpl::run()
+  /// Worker thread, packs the glyphs tallest first.
+  //--------------------------------------------------------------------------//
+  void AtlasRepacker::Pimpl::run(){
+    std::vector<size_t> order(layout.transfers.size());
+    for(size_t i=0; i < order.size(); ++i)
+      order[i]=i;
+    TallerFirst cmp={ layout.transfers };
+    std::sort(order.begin(), order.end(), cmp);
+
+    for(size_t i=0; i < order.size(); ++i){
+      if( !layout.add(layout.transfers[ order[i] ]) ){
+        layout.pages.clear();
+        break;
+      }
+    }
+    done=true;
+  }
+  //}}}
+}
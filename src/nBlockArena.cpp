@@ -0,0 +1,125 @@
+//==============================================================================
+/**
+\file            BlockArena.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nBlockArena.hpp"
+
+namespace ngl{
+  namespace{
+    const uint32_t kNone=~0u;
+  }
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ BlockArena(size_t blockSize)
+  ///   \param[in]  blockSize   Size of the blocks, bigger allocations get a
+  ///                           block of their own.
+  //--------------------------------------------------------------------------//
+  BlockArena::BlockArena(size_t blockSize)
+  :m_current(kNone), m_blockSize(blockSize), m_live(0), m_capacity(0){
+  }
+  //}}}-----------------------------------------------------------------------//
+  BlockArena::~BlockArena(){ //{{{
+    for(size_t i=0; i < m_blocks.size(); ++i)
+      delete[] m_blocks[i].data;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void* alloc(size_t size, uint32_t &block)
+  /// \param[out] block   Block the memory comes from, to be passed to
+  ///                     free().
+  /// \returns
+  ///   \a size bytes, aligned to kAlignment.
+  //--------------------------------------------------------------------------//
+  void* BlockArena::alloc(size_t size, uint32_t &block){
+    size=(size + kAlignment-1) & ~(kAlignment-1);
+    if( m_current == kNone
+        || m_blocks[m_current].top + size > m_blocks[m_current].size )
+      m_current=next_block(size);
+
+    Block &b=m_blocks[m_current];
+    void  *mem=b.data + b.top;
+    b.top +=size;
+    b.live+=size;
+    m_live+=size;
+    block=m_current;
+    return mem;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void free(uint32_t block, size_t size)
+  /// Gives back \a size bytes allocated from \a block. The block is
+  /// recycled when none of it is in use any more.
+  //--------------------------------------------------------------------------//
+  void BlockArena::free(uint32_t block, size_t size){
+    size=(size + kAlignment-1) & ~(kAlignment-1);
+    if( !size )
+      return;
+    Block &b=m_blocks[block];
+    b.live-=size;
+    m_live-=size;
+    if( b.live )
+      return;
+
+    b.top=0;
+    if( block != m_current )
+      m_free.push_back(block);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void seal()
+  /// Makes the following allocations start in an empty block, so live data
+  /// moved to new allocations leaves the old blocks.
+  //--------------------------------------------------------------------------//
+  void BlockArena::seal(){
+    if( m_current != kNone && m_blocks[m_current].live )
+      m_current=kNone;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ float fragmentation() const
+  /// \returns
+  ///   Share of the memory handed out from blocks still in use that was
+  ///   freed since, 0 to 1.
+  //--------------------------------------------------------------------------//
+  float BlockArena::fragmentation() const{
+    size_t handedOut=0;
+    for(size_t i=0; i < m_blocks.size(); ++i){
+      if( m_blocks[i].live )
+        handedOut+=m_blocks[i].top;
+    }
+    return ( handedOut ? 1.0f - (float)m_live / handedOut : 0.0f );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ uint32_t next_block(size_t size)
+  /// \returns
+  ///   An empty block with room for \a size bytes, recycled if possible.
+  //--------------------------------------------------------------------------//
+  uint32_t BlockArena::next_block(size_t size){
+    // The current block is full but still in use, it is recycled by free().
+    if( m_current != kNone && !m_blocks[m_current].live )
+      m_free.push_back(m_current);
+
+    for(size_t i=m_free.size(); i-- > 0; ){
+      uint32_t block=m_free[i];
+      if( m_blocks[block].size >= size ){
+        m_free.erase(m_free.begin()+i);
+        return block;
+      }
+    }
+
+    Block b;
+    b.size  =( size > m_blockSize ? size : m_blockSize );
+    b.data  =new byte[b.size];
+    b.top   =0;
+    b.live  =0;
+    m_blocks.push_back(b);
+    m_capacity+=b.size;
+    return m_blocks.size()-1;
+  }
+  //}}}
+}
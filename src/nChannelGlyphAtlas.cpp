@@ -0,0 +1,288 @@
+#include <nChannelGlyphAtlas.hpp>
+
+#include <GL/gl.h>
+#include <GL/glu.h>
+
+#include <cstring>
+
+namespace ngl{
+  //============================================================================
+  //{{{ ChannelGlyphAtlas::Shared
+  /// The RGBA textures and their CPU copies, shared by up to kChannels
+  /// atlases.
+  //============================================================================
+  struct ChannelGlyphAtlas::Shared{
+    Shared(const Size2 &size, bool linear);
+    ~Shared();
+
+    void    add_page(size_t page);
+    size_t  write(size_t page, int channel, const Region &rect,
+                  const byte *plane);
+    size_t  clear(size_t page, int channel);
+    size_t  upload(size_t page, const Region &rect);
+
+    static std::shared_ptr<Shared> acquire(const Size2 &size, bool linear,
+                                           int &channel);
+
+    Size2                             size;
+    bool                              linear;
+    bool                              used[kChannels];
+    std::vector<TextureID>            textures;
+    std::vector< std::vector<byte> >  pixels;   // RGBA, rows bottom-up.
+
+    // Textures with a free channel are looked up here.
+    static std::vector< std::weak_ptr<Shared> >  all;
+  };//}}}
+
+  std::vector< std::weak_ptr<ChannelGlyphAtlas::Shared> >
+    ChannelGlyphAtlas::Shared::all;
+
+
+
+  //--------------------------------------------------------------------------//
+  // {{{ ChannelGlyphAtlas::ChannelGlyphAtlas(size_t width, ...)
+  /// \brief  Default constructor, takes the first free channel of a shared
+  ///         texture with the same page size and filtering, or of a new one.
+  ///   \param[in]  width, height   Size of every page.
+  ///   \param[in]  linear          Use linear texture filtering.
+  //--------------------------------------------------------------------------//
+  ChannelGlyphAtlas::ChannelGlyphAtlas(size_t width, size_t height,
+                                       bool linear)
+  :   MemoryGlyphAtlas( width, height ),
+      m_channel       ( 0 ),
+      m_uploaded      ( 0 )
+  {
+    m_shared=Shared::acquire(m_size, linear, m_channel);
+    // The first page was added before page_added() was ours.
+    for(size_t i=0; i < pages(); ++i)
+      page_added(i);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ ChannelGlyphAtlas(const ChannelGlyphAtlas &obj)
+  /// Copy constructor.
+  ///   \param[in]  obj   ChannelGlyphAtlas to copy from.
+  ///
+  //--------------------------------------------------------------------------//
+  ChannelGlyphAtlas::ChannelGlyphAtlas(const ChannelGlyphAtlas &obj)
+  :MemoryGlyphAtlas(0, 0){
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ ~ChannelGlyphAtlas()
+  ChannelGlyphAtlas::~ChannelGlyphAtlas(){
+    if( !m_shared )
+      return;
+    // The next face taking the channel only writes its own glyphs, ours
+    // would show through. Not needed if the textures go with us.
+    if( m_shared.use_count() > 1 ){
+      for(size_t i=0; i < pages(); ++i)
+        m_shared->clear(i, m_channel);
+    }
+    m_shared->used[m_channel]=false;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ ChannelGlyphAtlas& operator=(const ChannelGlyphAtlas &obj)
+  /// Assign operator
+  ///    \param[in] obj   ChannelGlyphAtlas to assign to this.
+  /// \returns
+  /// Reference to itself.
+  //--------------------------------------------------------------------------//
+  ChannelGlyphAtlas &ChannelGlyphAtlas::operator=(const ChannelGlyphAtlas &obj){
+    return *this;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Error flush()
+  /// Copies the dirty parts of the pages into our channel of the shared
+  /// textures and uploads them.
+  //--------------------------------------------------------------------------//
+  Error ChannelGlyphAtlas::flush(){
+    for(size_t i=0; i < m_pages.size(); ++i){
+      Page &page=*m_pages[i];
+      if( page.dirty.max.x <= page.dirty.min.x
+          || page.dirty.max.y <= page.dirty.min.y )
+        continue;
+
+      m_uploaded+=m_shared->write(i, m_channel, page.dirty, &page.pixels[0]);
+      page.dirty.min=page.dirty.max=uint2(0, 0);
+    }
+    return gl_error_check("ChannelGlyphAtlas::flush");
+  }
+  //}}}-----------------------------------------------------------------------//
+  TextureID ChannelGlyphAtlas::texid(size_t page) const{ //{{{
+    return ( page < m_shared->textures.size() ? m_shared->textures[page] : 0 );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool supported()
+  /// \returns
+  ///   True if the renderers can select a channel of a texture, which
+  ///   needs texture swizzling (ARB_texture_swizzle, core since GL 3.3).
+  //--------------------------------------------------------------------------//
+  bool ChannelGlyphAtlas::supported(){
+    const char *ext=(const char*)glGetString(GL_EXTENSIONS);
+    return ext && ( strstr(ext, "GL_ARB_texture_swizzle")
+                    || strstr(ext, "GL_EXT_texture_swizzle") );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void page_added(size_t page)
+  /// Makes sure the shared texture has the page too.
+  //--------------------------------------------------------------------------//
+  void ChannelGlyphAtlas::page_added(size_t page){
+    if( m_shared )
+      m_shared->add_page(page);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void page_removed(size_t page)
+  /// Clears our channel of the page; the shared texture stays, other faces
+  /// may use it, and the page may come back (repack).
+  //--------------------------------------------------------------------------//
+  void ChannelGlyphAtlas::page_removed(size_t page){
+    if( m_shared )
+      m_uploaded+=m_shared->clear(page, m_channel);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Shared::Shared(const Size2 &size, bool linear)
+  //--------------------------------------------------------------------------//
+  ChannelGlyphAtlas::Shared::Shared(const Size2 &size, bool linear)
+  :   size    ( size ),
+      linear  ( linear )
+  {
+    for(size_t c=0; c < kChannels; ++c)
+      used[c]=false;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Shared::~Shared()
+  ChannelGlyphAtlas::Shared::~Shared(){
+    if( !textures.empty() )
+      glDeleteTextures(textures.size(), &textures[0]);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ std::shared_ptr<Shared> Shared::acquire(const Size2 &size, ...)
+  /// Finds shared textures with a free channel, or creates new ones.
+  ///   \param[out] channel   The channel taken.
+  //--------------------------------------------------------------------------//
+  std::shared_ptr<ChannelGlyphAtlas::Shared>
+  ChannelGlyphAtlas::Shared::acquire(const Size2 &size, bool linear,
+                                     int &channel){
+    for(size_t i=0; i < all.size(); ){
+      std::shared_ptr<Shared> shared=all[i].lock();
+      if( !shared ){
+        all.erase(all.begin()+i);
+        continue;
+      }
+      ++i;
+      if( shared->size.width != size.width
+          || shared->size.height != size.height || shared->linear != linear )
+        continue;
+      for(size_t c=0; c < kChannels; ++c){
+        if( !shared->used[c] ){
+          shared->used[c]=true;
+          channel=c;
+          return shared;
+        }
+      }
+    }
+
+    std::shared_ptr<Shared> shared(new Shared(size, linear));
+    shared->used[0]=true;
+    channel=0;
+    all.push_back(shared);
+    return shared;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void Shared::add_page(size_t page)
+  /// Creates the textures up to \a page, cleared to 0 in all channels.
+  //--------------------------------------------------------------------------//
+  void ChannelGlyphAtlas::Shared::add_page(size_t page){
+    GLint filter=( linear ? GL_LINEAR : GL_NEAREST );
+    while( textures.size() <= page ){
+      pixels.push_back( std::vector<byte>(size.width*size.height*4, 0) );
+      textures.push_back(0);
+
+      glPushAttrib    ( GL_TEXTURE_BIT );
+      glPushClientAttrib( GL_CLIENT_PIXEL_STORE_BIT );
+      glGenTextures   ( 1, &textures.back() );
+      glBindTexture   ( GL_TEXTURE_2D, textures.back() );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter );
+      glPixelStorei   ( GL_UNPACK_ALIGNMENT, 4 );
+      glPixelStorei   ( GL_UNPACK_ROW_LENGTH, 0 );
+      glTexImage2D    ( GL_TEXTURE_2D,
+                        0,
+                        GL_RGBA,
+                        size.width,
+                        size.height,
+                        0,
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        &pixels.back()[0] );
+      glPopClientAttrib();
+      glPopAttrib     ();
+    }
+    gl_error_check("ChannelGlyphAtlas::Shared::add_page");
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t Shared::write(size_t page, int channel, ...)
+  /// Copies \a rect of a single channel \a plane into \a channel of the
+  /// page and uploads it.
+  /// \returns
+  ///   Bytes uploaded.
+  //--------------------------------------------------------------------------//
+  size_t ChannelGlyphAtlas::Shared::write(size_t page, int channel,
+                                          const Region &rect,
+                                          const byte *plane){
+    std::vector<byte> &rgba=pixels[page];
+    for(size_t y=rect.min.y; y < rect.max.y; ++y){
+      const byte  *src=plane + y*size.width;
+      byte        *dst=&rgba[ y*size.width*4 + channel ];
+      for(size_t x=rect.min.x; x < rect.max.x; ++x)
+        dst[x*4]=src[x];
+    }
+    return upload(page, rect);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t Shared::clear(size_t page, int channel)
+  /// Zeroes \a channel of the whole page and uploads it.
+  /// \returns
+  ///   Bytes uploaded.
+  //--------------------------------------------------------------------------//
+  size_t ChannelGlyphAtlas::Shared::clear(size_t page, int channel){
+    if( page >= pixels.size() )
+      return 0;
+    std::vector<byte> &rgba=pixels[page];
+    for(size_t i=channel; i < rgba.size(); i+=4)
+      rgba[i]=0;
+
+    Region rect;
+    rect.min.set(0, 0);
+    rect.max.set(size.width, size.height);
+    return upload(page, rect);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t Shared::upload(size_t page, const Region &rect)
+  /// Uploads \a rect of the page. The whole texels go up, the other
+  /// channels are sent back unchanged.
+  /// \returns
+  ///   Bytes uploaded.
+  //--------------------------------------------------------------------------//
+  size_t ChannelGlyphAtlas::Shared::upload(size_t page, const Region &rect){
+    std::vector<byte> &rgba=pixels[page];
+    const Size2 rectSize(rect.max.x-rect.min.x, rect.max.y-rect.min.y);
+    glPushAttrib      ( GL_TEXTURE_BIT );
+    glPushClientAttrib( GL_CLIENT_PIXEL_STORE_BIT );
+    glBindTexture     ( GL_TEXTURE_2D, textures[page] );
+    glPixelStorei     ( GL_UNPACK_ALIGNMENT,  4 );
+    glPixelStorei     ( GL_UNPACK_ROW_LENGTH, (GLint)size.width );
+    glTexSubImage2D   ( GL_TEXTURE_2D,
+                        0,
+                        static_cast<GLint>(rect.min.x),
+                        static_cast<GLint>(rect.min.y),
+                        static_cast<GLsizei>(rectSize.width),
+                        static_cast<GLsizei>(rectSize.height),
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        &rgba[ (rect.min.y*size.width + rect.min.x)*4 ] );
+    glPopClientAttrib ();
+    glPopAttrib       ();
+    return rectSize.width*rectSize.height*4;
+  }
+  //}}}
+}
@@ -0,0 +1,117 @@
+//==============================================================================
+/**
+\file            FaceRegistry.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nFaceRegistry.hpp"
+#include "nFontFace.hpp"
+#include "nGlyphSDF.hpp"
+
+#include <cstdio>
+#include <map>
+#include <thread>
+
+namespace ngl{
+  namespace faces{
+    struct Key{
+      String    face;
+      size_t    size;
+      uint32_t  flags;
+
+      bool operator<(const Key &obj) const{
+        if( size != obj.size )
+          return size < obj.size;
+        if( flags != obj.flags )
+          return flags < obj.flags;
+        return face < obj.face;
+      }
+    };
+    struct Entry{
+      FontFace  *face;
+      size_t    refs;
+    };
+    typedef std::map<Key, Entry>  Registry;
+
+    static Registry           g_registry;
+    static FaceRegistryStats  g_stats;
+
+    //------------------------------------------------------------------------//
+    //{{{ FontFace* acquire(const String &face, size_t sizeInPt, uint32_t flags)
+    /// Returns the shared face for \a face at \a sizeInPt, loading it on first
+    /// use. Every call has to be matched by a release(). SDF faces are
+    /// loaded at sdf::kReferenceSize whatever \a sizeInPt is, the caller
+    /// scales them (see Font).
+    ///   \param[in]  face      Font file.
+    ///   \param[in]  sizeInPt  Size in pt.
+    ///   \param[in]  flags     FaceFlags, faces with different flags are never
+    ///                         shared.
+    //------------------------------------------------------------------------//
+    FontFace* acquire(const String &face, size_t sizeInPt, uint32_t flags){
+      if( flags & FaceFlags::SDF )
+        sizeInPt=sdf::kReferenceSize;
+
+      Key key;
+      key.face  =face;
+      key.size  =sizeInPt;
+      key.flags =flags;
+
+      Registry::iterator it=g_registry.find(key);
+      if( it != g_registry.end() ){
+        ++it->second.refs;
+        ++g_stats.references;
+        ++g_stats.hits;
+        g_stats.memorySaved+=it->second.face->memory_usage();
+        return it->second.face;
+      }
+
+      Entry entry;
+      entry.face=new FontFace(face, sizeInPt, flags);
+      entry.refs=1;
+      if( flags & FaceFlags::Async ){
+        size_t numThreads=std::thread::hardware_concurrency();
+        entry.face->set_async( numThreads > 1 ? numThreads-1 : 1 );
+      }
+      g_registry.insert( Registry::value_type(key, entry) );
+
+      ++g_stats.faces;
+      ++g_stats.references;
+      ++g_stats.created;
+      return entry.face;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ void release(FontFace *face)
+    /// Drops a reference taken by acquire(), the face is deleted with the
+    /// last one.
+    //------------------------------------------------------------------------//
+    void release(FontFace *face){
+      if( !face )
+        return;
+
+      for(Registry::iterator it=g_registry.begin(); it!=g_registry.end(); ++it){
+        if( it->second.face != face )
+          continue;
+
+        --g_stats.references;
+        if( --it->second.refs == 0 ){
+          delete it->second.face;
+          g_registry.erase(it);
+          --g_stats.faces;
+        }
+        return;
+      }
+      fprintf(stderr, "Releasing face %p that is not in the registry.\n",
+              (void*)face);
+    }
+    //}}}---------------------------------------------------------------------//
+    const FaceRegistryStats& stats(){ //{{{
+      return g_stats;
+    }
+    //}}}
+  }
+}
@@ -11,32 +11,86 @@ Copyright (c) 2010 Mateusz 'novo' Klos.
 //==============================================================================
 #include "nFont.hpp"
 #include "nFontFace.hpp"
+#include "nFaceRegistry.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <GL/gl.h>
 #include <GL/glu.h>
 
 namespace ngl{
+  namespace{
+    // Share of the cache arena that may be dead before it is compacted.
+    const float kMaxFragmentation=0.5f;
+    // Initial size of the resident vertex buffer, in quads.
+    const size_t kResidentQuads=4096;
+
+    // Font::Resident serials, unique over all fonts so a renderer never
+    // takes another font's updates for its own.
+    uint32_t g_residentSerial=0;
+
+    // Copies count vertices moved by offset.
+    void copy_moved(Font::Vertex *dst, const Font::Vertex *src, size_t count,
+                    const int2 &offset){
+      for(size_t i=0; i < count; ++i){
+        dst[i]           =src[i];
+        dst[i].position +=offset;
+      }
+    }
+
+    // Two triangles per quad, the pattern of quad_indices().
+    std::vector<Triangle16> make_quad_indices(){
+      std::vector<Triangle16> indices(Font::kMaxQuads*2);
+      for(size_t q=0; q < Font::kMaxQuads; ++q){
+        const uint16_t v=q*4;
+        indices[q*2+0].set(v+0, v+1, v+3);
+        indices[q*2+1].set(v+3, v+1, v+2);
+      }
+      return indices;
+    }
+
+    struct ByResidentAddress{
+      template<typename Entry>
+      bool operator()(const Entry *ls, const Entry *rs) const{
+        return ls->resident < rs->resident;
+      }
+    };
+  }
+
+
+
   //--------------------------------------------------------------------------//
   /// \brief  Default constructor.
+  ///
+  /// Fonts with the same face, size and flags share one FontFace (and atlas),
+  /// see faces::acquire(). With FaceFlags::SDF all sizes share one face and
+  /// the glyphs are scaled from the reference size.
+  ///   \param[in]  faceFlags   FaceFlags.
   //--------------------------------------------------------------------------//
-  Font::Font(const String &face, size_t sizeInPt)
+  Font::Font(const String &face, size_t sizeInPt, uint32_t faceFlags)
   :m_face(NULL),
+  m_scale(1.0f),
   m_counter(0),
   m_vertCount(0),
   m_cacheUpdated(false),
-  m_cacheTTL(1){
-    m_face=new FontFace(face, sizeInPt);
+  m_cacheTTL(1),
+  m_cacheHits(0),
+  m_cacheMisses(0){
+    m_resident.vb           =NULL;
+    m_resident.capacity     =0;
+    m_resident.serial       =0;
+    m_resident.prevSerial   =0;
+    m_face=faces::acquire(face, sizeInPt, faceFlags);
+    if( m_face->size() )
+      m_scale=(float)sizeInPt / m_face->size();
   }
   //--------------------------------------------------------------------------//
   /// \brief  Destructor.
   //--------------------------------------------------------------------------//
   Font::~Font(){
-    if(m_face)
-      delete m_face;
-    for(Cache::const_iterator it=m_cache.begin(); it!=m_cache.end();++it){
-      delete[] it->verts;
-    }
+    faces::release(m_face);
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
@@ -52,7 +106,7 @@ namespace ngl{
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   void Font::init_position(const int screenHeight){
-    set_position( int2(5, screenHeight-m_face->maxSize().height) );
+    set_position( int2(5, screenHeight-line_height()) );
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
@@ -68,35 +122,18 @@ namespace ngl{
       return;
 
     // Check cache.
-    CacheEntry *cached=find_cached(msg);
-    if( cached ){
-      cached->lastUsed=m_counter;
-      m_position+=cached->positionDelta;
-      return;
+    const Hash64_t key=cache_key(msg, color, false);
+    CacheEntry *ce=find_cached(key, msg, color, false);
+    if( ce ){
+      ce->lastUsed=m_counter;
+      m_face->touch_pages(ce->pageMask);
     }
-
-    CacheEntry *ce=cache(msg);
-
-    int2 position=m_position;
-    const char *str=msg.c_str();
-    for(int i=0; i<msg.length(); ++i){
-
-      const Glyph &glyph  =m_face->get_glyph( msg[i]=='\n' ? ' ' : msg[i] );
-      if( glyph == Glyph::null ){
-        fprintf(stderr, "Failed to load glyph '%c'.\n", msg[i]);
-        continue;
-      }
-
-      generate(ce->verts, i, glyph, position, color);
-      
-      position.x+=glyph.advance;
-      if( msg[i] == '\n' ){
-        position.x   =m_position.x;
-        position.y  -=m_face->maxSize().y;
-      }
+    else{
+      ce=cache(key, msg, color, false);
+      build(*ce, true);
     }
-    ce->positionDelta =position - m_position;
-    m_position        =position;
+    add_instance(ce);
+    m_position+=ce->positionDelta;
   }
   //--------------------------------------------------------------------------//
   /// \remarks
@@ -107,18 +144,28 @@ namespace ngl{
       return;
 
     // Check cache.
-    CacheEntry *cached=find_cached(msg);
-    if( cached ){
-      cached->lastUsed=m_counter;
-      m_position+=cached->positionDelta;
-      return;
+    const Hash64_t key=cache_key(msg, Color32::white, true);
+    CacheEntry *ce=find_cached(key, msg, Color32::white, true);
+    if( ce ){
+      ce->lastUsed=m_counter;
+      m_face->touch_pages(ce->pageMask);
     }
-
-    CacheEntry *ce=cache(msg);
-
-    int2 position=m_position;
-    const char *str=msg.c_str();
-    Color32 color(Color32::white);
+    else{
+      ce=cache(key, msg, Color32::white, true);
+      build(*ce, true);
+    }
+    add_instance(ce);
+    m_position+=ce->positionDelta;
+  }
+  //--------------------------------------------------------------------------//
+  /// Generates the quads of \a ce from its text, relative to where it is
+  /// printed (see Instance). With colorCodes, "^N" and "^NN" switch the
+  /// color and "^^" prints '^', like cprint() documents.
+  ///   \param[in]  load    Load missing glyphs; otherwise only the glyphs
+  ///                       in the atlas are used and the entry is left
+  ///                       incomplete if some are not.
+  //--------------------------------------------------------------------------//
+  void Font::build(CacheEntry &ce, bool load){
     Color32 colors[]={
       Color32::white,         // 0
       Color32::red,           // 1
@@ -137,124 +184,524 @@ namespace ngl{
       Color32::darkBlue,      // 14
       Color32::orange         // 15
     };
+    ce.pageMask =0;
+    ce.epoch    =m_face->epoch();
+    ce.complete =true;
+
+    int2 position(0, 0);
+    Color32 color(ce.color);
+    const char *str=ce.text;
+    const char *end=str+ce.textLength;
     int vi=0;
-    for(int i=0; i<msg.length(); ++i){
-      if( msg[i] == '\n' ){
-        position.x   =m_position.x;
-        position.y  -=m_face->maxSize().y;
-        continue;
-      }
-      else if(msg[i] == '^'){
-        if( msg[++i]!='^' ){
-          if( msg[i] >= '0' && msg[i] <= '9' ){
-            if( msg[i+1] >= '0' && msg[i+1] <= '9' ){
-              color=colors[ (msg[i]-'0') * 10 + (msg[i+1]-'0') ];
-              ++i;
+    while( str < end ){
+      if( ce.colorCodes ){
+        if( *str == '\n' ){
+          position.x   =0;
+          position.y  -=line_height();
+          ++str;
+          continue;
+        }
+        else if( *str == '^' ){
+          if( ++str == end )
+            break;
+          if( *str >= '0' && *str <= '9' ){
+            if( str+1 < end && str[1] >= '0' && str[1] <= '9' ){
+              color=colors[ (str[0]-'0') * 10 + (str[1]-'0') ];
+              ++str;
             }
             else
-              color=colors[msg[i]-'0'];
+              color=colors[*str-'0'];
+            ++str;
             continue;
           }
         }
       }
 
-      const Glyph &glyph  =m_face->get_glyph(msg[i]);
+      Codepoint code =utf8_decode(str, end);
+      Codepoint shown=( code=='\n' ? ' ' : code );
+      const Glyph &glyph  =( load ? m_face->get_glyph(shown)
+                                  : m_face->find_glyph(shown) );
+      if( glyph == Glyph::pending ){
+        ce.complete=false;
+        continue;
+      }
       if( glyph == Glyph::null ){
-        fprintf(stderr, "Failed to load glyph '%c'.\n", msg[i]);
+        fprintf(stderr, "Failed to load glyph U+%04X.\n", code);
         continue;
       }
-      
-      generate(ce->verts, vi, glyph, position, color);
-      position.x+=glyph.advance;
+
+      generate(ce.verts, vi, glyph, position, color);
+      ce.pages[vi]  =glyph.page;
+      ce.pageMask  |=1u << glyph.page;
       ++vi;
+
+      position.x+=advance(glyph);
+      if( code == '\n' ){
+        position.x   =0;
+        position.y  -=line_height();
+      }
     }
-    ce->vertCount     =vi*4;
-    ce->positionDelta =position - m_position;
-    m_position        =position;
+    ce.vertCount     =vi*4;
+    ce.positionDelta =position;
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   void Font::generate(Vertex *verts, int index, const Glyph &glyph,
                       const int2 &position, Color32 color){
-    verts[index*4+0].position.set(glyph.off.x+position.x,
-                              glyph.off.y+position.y);
+    // Quad corners, glyph metrics scaled to the font size.
+    const int x0=position.x + lroundf(glyph.off.x * m_scale);
+    const int y0=position.y + lroundf(glyph.off.y * m_scale);
+    const int x1=x0 + lroundf(glyph.size.width  * m_scale);
+    const int y1=y0 + lroundf(glyph.size.height * m_scale);
+
+    verts[index*4+0].position.set(x0, y0);
     verts[index*4+0].texCoord =glyph.botLeft;
     verts[index*4+0].color    =color;
 
-    verts[index*4+1].position.set(glyph.off.x+position.x+glyph.size.width,
-                              glyph.off.y+position.y);
+    verts[index*4+1].position.set(x1, y0);
     verts[index*4+1].texCoord.set(glyph.topRight.u, glyph.botLeft.v);
     verts[index*4+1].color    =color;
 
-    verts[index*4+2].position.set(glyph.off.x+position.x+glyph.size.width,
-                              glyph.off.y+position.y+glyph.size.height);
+    verts[index*4+2].position.set(x1, y1);
     verts[index*4+2].texCoord =glyph.topRight;
     verts[index*4+2].color    =color;
 
-    verts[index*4+3].position.set(glyph.off.x+position.x,
-                              glyph.off.y+position.y+glyph.size.height);
+    verts[index*4+3].position.set(x0, y1);
     verts[index*4+3].texCoord.set(glyph.botLeft.u, glyph.topRight.v);
     verts[index*4+3].color    =color;
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
-  void Font::get_geometry(Vertex *vb, Triangle16 *ib, TextureID &texID) const{
+  int Font::advance(const Glyph &glyph) const{
+    return lroundf(glyph.advance * m_scale);
+  }
+  //--------------------------------------------------------------------------//
+  //--------------------------------------------------------------------------//
+  int Font::line_height() const{
+    return lroundf(m_face->maxSize().height * m_scale);
+  }
+  //--------------------------------------------------------------------------//
+  /// \returns
+  ///   Width of the widest line of \a text at this font's size, see
+  ///   FontFace::text_width().
+  //--------------------------------------------------------------------------//
+  size_t Font::text_width(const String &text){
+    return m_face->text_width(text, m_scale);
+  }
+  //--------------------------------------------------------------------------//
+  /// Wraps \a text to \a width pixels at this font's size, see
+  /// FontFace::split().
+  //--------------------------------------------------------------------------//
+  size_t Font::split(const String &text, size_t width, StringList &lines,
+                     TextWrapMode wrapMode){
+    return m_face->split(text, width, lines, wrapMode, m_scale);
+  }
+  //--------------------------------------------------------------------------//
+  //--------------------------------------------------------------------------//
+  bool Font::is_sdf() const{
+    return m_face->is_sdf();
+  }
+  //--------------------------------------------------------------------------//
+  /// Fills \a vb with the cached text. The quads are grouped by atlas page,
+  /// one Batch per texture to draw; the indices are always the same, see
+  /// quad_indices().
+  //--------------------------------------------------------------------------//
+  void Font::get_geometry(Vertex *vb, Batches &batches) const{
+    const IGlyphAtlas *atlas=m_face->atlas();
+    const size_t      pages=atlas->pages();
     size_t vOff =0;
-    for(Cache::const_iterator i=m_cache.begin(); i != m_cache.end(); ++i){
-      memcpy( &vb[vOff], i->verts,  (i->vertCount)  *sizeof(Font::Vertex) );
-      vOff+=i->vertCount;
+    batches.clear();
+    if( pages == 1 ){
+      for(Instances::const_iterator i=m_drawn.begin(); i != m_drawn.end(); ++i){
+        const CacheEntry &ce=m_cache[i->entry];
+        copy_moved( &vb[vOff], ce.verts, ce.vertCount, i->position );
+        vOff+=ce.vertCount;
+      }
     }
-    size_t tOff =0;
-    for(int i=0; i < vOff; i+=4, tOff+=2){
-      ib[tOff+0].set(i+0, i+1, i+3);
-      ib[tOff+1].set(i+3, i+1, i+2);
+    else{
+      // Count the quads of each page, then scatter them so every page's
+      // quads are contiguous. Quads on pages the atlas does not have any
+      // more are dropped; update_cache() rebuilds such entries, so there
+      // should be none.
+      std::vector<size_t> &first=m_pageFirst;
+      first.assign(pages+1, 0);
+      for(Instances::const_iterator i=m_drawn.begin(); i != m_drawn.end(); ++i){
+        const CacheEntry &ce=m_cache[i->entry];
+        for(size_t q=0; q < ce.vertCount/4; ++q){
+          if( ce.pages[q] < pages )
+            ++first[ ce.pages[q]+1 ];
+        }
+      }
+      for(size_t p=1; p <= pages; ++p)
+        first[p]+=first[p-1];
+
+      std::vector<size_t> &next=m_pageNext;
+      next.assign(first.begin(), first.end()-1);
+      for(Instances::const_iterator i=m_drawn.begin(); i != m_drawn.end(); ++i){
+        const CacheEntry &ce=m_cache[i->entry];
+        for(size_t q=0; q < ce.vertCount/4; ++q){
+          if( ce.pages[q] >= pages )
+            continue;
+          copy_moved( &vb[ next[ ce.pages[q] ]++ * 4 ], &ce.verts[q*4], 4,
+                      i->position );
+        }
+        vOff+=ce.vertCount;
+      }
+      for(size_t p=0; p < pages; ++p){
+        if( first[p+1] == first[p] )
+          continue;
+        Batch batch={ atlas->texid(p), atlas->channel(),
+                      first[p]*2, (first[p+1]-first[p])*2 };
+        batches.push_back(batch);
+      }
+    }
+    if( pages == 1 && vOff ){
+      Batch batch={ atlas->texid(), atlas->channel(), 0, vOff/2 };
+      batches.push_back(batch);
     }
-    texID=m_face->atlas()->texid();
+  }
+  //--------------------------------------------------------------------------//
+  /// \returns
+  ///   Indices of kMaxQuads quads, built once and shared by every font and
+  ///   renderer: quad q is vertices 4q to 4q+3, as two triangles.
+  //--------------------------------------------------------------------------//
+  const Triangle16* Font::quad_indices(){
+    static const std::vector<Triangle16> indices=make_quad_indices();
+    return &indices[0];
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   void Font::update_cache(){
-    Cache::iterator tmp;
-    m_vertCount=0;
+    m_face->update();
+    rebuild_printed();
+
+    // Drop the entries not used in the last frame, keeping the order of
+    // the rest.
+    size_t kept=0;
     ++m_counter;
-    for(Cache::iterator it=m_cache.begin(); it!=m_cache.end();){
-      if( m_cacheTTL && it->lastUsed == m_counter-1 ){
-        m_vertCount +=it->vertCount;
-        ++it;
+    m_remap.assign(m_cache.size(), kInvalidIndex);
+    for(size_t i=0; i < m_cache.size(); ++i){
+      CacheEntry &ce=m_cache[i];
+      if( m_cacheTTL && ce.lastUsed == m_counter-1 ){
+        m_remap[i]=kept;
+        if( kept != i ){
+          std::swap(m_cache[kept], ce);
+          *m_cacheIndex.find(m_cache[kept].hash)=kept;
+        }
+        ++kept;
       }
       else{
-        delete[] it->verts;
-        tmp=it;
-        ++it;
-        m_cache.erase(tmp);
+        release(ce);
+        m_cacheIndex.erase(ce.hash);
       }
     }
+    m_cache.resize(kept);
+    if( m_arena.fragmentation() > kMaxFragmentation )
+      compact_cache();
+
+    // This frame's prints are what is drawn until the next update.
+    m_drawn.swap(m_printed);
+    m_printed.clear();
+    m_vertCount=0;
+    size_t drawn=0;
+    for(size_t i=0; i < m_drawn.size(); ++i){
+      const uint32_t entry=m_remap[ m_drawn[i].entry ];
+      if( entry == kInvalidIndex )
+        continue;
+      m_drawn[drawn].entry    =entry;
+      m_drawn[drawn].position =m_drawn[i].position;
+      m_vertCount+=m_cache[entry].vertCount;
+      ++drawn;
+    }
+    m_drawn.resize(drawn);
+    update_resident();
     m_cacheUpdated=true;
     m_position=m_requestedPosition;
   }
   //--------------------------------------------------------------------------//
+  /// Regenerates the entries printed in this frame that are older than the
+  /// face's epoch. FontFace::update() (this font's or that of another font
+  /// sharing the face) may have repacked the atlas or evicted pages after
+  /// they were printed, so their texture coordinates can be out of date.
+  /// Only the glyphs in the atlas are used: nothing is loaded, and no page
+  /// is evicted, this late in the frame.
+  //--------------------------------------------------------------------------//
+  void Font::rebuild_printed(){
+    const uint32_t epoch=m_face->epoch();
+    for(size_t i=0; i < m_cache.size(); ++i){
+      CacheEntry &ce=m_cache[i];
+      if( ce.lastUsed != m_counter || ce.epoch == epoch )
+        continue;
+      if( ce.resident ){
+        m_residentPool.free(ce.resident);
+        ce.resident=NULL;
+      }
+      build(ce, false);
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// \returns
+  ///   Hash of what makes the geometry of \a msg: the text, its color and
+  ///   whether color codes are interpreted. Where it is printed does not
+  ///   matter, the geometry is relative to that. Collisions are resolved by
+  ///   probe(); virtual so tests can force them.
+  //--------------------------------------------------------------------------//
+  Hash64_t Font::cache_key(const String &msg, const Color32 &color,
+                           bool colorCodes) const{
+    const uint32_t head[2]={ color.value, colorCodes };
+    return gen_hash64(msg.data(), msg.size(), gen_hash64(head, sizeof(head)));
+  }
   //--------------------------------------------------------------------------//
-  Font::CacheEntry* Font::cache(const String &msg){
-    m_cache.push_back( CacheEntry() );
-    CacheEntry &ce=m_cache.back();
-    ce.hash         =gen_hash( (const byte*)&m_position, sizeof(m_position) );
-    ce.hash         =gen_hash(msg, ce.hash);
+  /// Follows the keys of \a key's probe sequence to the entry holding
+  /// \a msg, or to the first free key. A different text under a key (a hash
+  /// collision) is skipped, not replaced: instances printed earlier in the
+  /// frame still draw it.
+  ///   \param[in,out] key   Where the entry is, or goes.
+  /// \returns
+  ///   Index of the entry holding \a msg, or NULL.
+  //--------------------------------------------------------------------------//
+  uint32_t* Font::probe(Hash64_t &key, const String &msg,
+                        const Color32 &color, bool colorCodes){
+    for(;;){
+      uint32_t *index=m_cacheIndex.find(key);
+      if( !index )
+        return NULL;
+      const CacheEntry &ce=m_cache[*index];
+      if( ce.color.value == color.value && ce.colorCodes == colorCodes
+          && ce.textLength == msg.length()
+          && !memcmp(ce.text, msg.data(), ce.textLength) )
+        return index;
+      key=gen_hash64(&key, sizeof(key), key);
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// Adds the entry for \a key. An entry of the same text left over
+  /// (incomplete, or from an older epoch) is replaced in place.
+  //--------------------------------------------------------------------------//
+  Font::CacheEntry* Font::cache(Hash64_t key, const String &msg,
+                                const Color32 &color, bool colorCodes){
+    const uint32_t *index=probe(key, msg, color, colorCodes);
+    if( index )
+      release(m_cache[*index]);
+    else{
+      index=&m_cacheIndex.insert(key, m_cache.size());
+      m_cache.push_back( CacheEntry() );
+    }
+    // One quad per byte at most.
+    const size_t quads=msg.length();
+    CacheEntry &ce=m_cache[*index];
+    ce.bytes        =quads*4*sizeof(Vertex) + quads*sizeof(uint32_t) + quads;
+    byte *mem       =(byte*)m_arena.alloc(ce.bytes, ce.block);
+    ce.verts        =(Vertex*)mem;
+    ce.pages        =(uint32_t*)(mem + quads*4*sizeof(Vertex));
+    ce.text         =(char*)(ce.pages + quads);
+    memcpy((char*)ce.text, msg.data(), quads);
+    ce.textLength   =quads;
+    ce.hash         =key;
+    ce.color        =color;
+    ce.colorCodes   =colorCodes;
     ce.lastUsed     =m_counter;
-    ce.vertCount    =msg.length()*4;
-    ce.verts        =new Vertex[ce.vertCount];
+    ce.vertCount    =0;
+    ce.resident     =NULL;
     m_cacheUpdated  =false;
     return &ce;
   }
   //--------------------------------------------------------------------------//
+  /// \returns
+  ///   The entry of \a msg if it is still good to draw, NULL otherwise.
   //--------------------------------------------------------------------------//
-  Font::CacheEntry* Font::find_cached(const String &msg){
-    Hash_t hash =gen_hash( (const byte*)&m_position, sizeof(m_position) );
-    hash        =gen_hash(msg, hash);
-
-    for(Cache::iterator it=m_cache.begin(); it!=m_cache.end();++it){
-      if( it->hash == hash )
-        return &*it;
+  Font::CacheEntry* Font::find_cached(Hash64_t key, const String &msg,
+                                      const Color32 &color, bool colorCodes){
+    // Incomplete entries are regenerated until all their glyphs are loaded,
+    // and so are entries built before glyphs were evicted from the atlas.
+    const uint32_t *index=probe(key, msg, color, colorCodes);
+    if( index ){
+      CacheEntry &ce=m_cache[*index];
+      if( ce.complete && ce.epoch == m_face->epoch() ){
+        ++m_cacheHits;
+        return &ce;
+      }
     }
+    ++m_cacheMisses;
     return NULL;
   }
+  //--------------------------------------------------------------------------//
+  /// Gives the arena memory of \a ce back.
+  //--------------------------------------------------------------------------//
+  void Font::release(CacheEntry &ce){
+    m_arena.free(ce.block, ce.bytes);
+    if( ce.resident ){
+      m_residentPool.free(ce.resident);
+      ce.resident=NULL;
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// Moves every entry to new arena memory, in drawing order, so the blocks
+  /// kept alive by a few long lived entries are emptied and recycled.
+  //--------------------------------------------------------------------------//
+  void Font::compact_cache(){
+    m_arena.seal();
+    for(size_t i=0; i < m_cache.size(); ++i){
+      CacheEntry  &ce=m_cache[i];
+      uint32_t    block;
+      byte        *mem=(byte*)m_arena.alloc(ce.bytes, block);
+      memcpy(mem, ce.verts, ce.bytes);
+      m_arena.free(ce.block, ce.bytes);
+
+      const size_t quads=ce.textLength;
+      ce.block  =block;
+      ce.verts  =(Vertex*)mem;
+      ce.pages  =(uint32_t*)(mem + quads*4*sizeof(Vertex));
+      ce.text   =(char*)(ce.pages + quads);
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// Copies the entries cached since the last update to m_resident.
+  //--------------------------------------------------------------------------//
+  void Font::update_resident(){
+    m_resident.prevSerial=m_resident.serial;
+    m_resident.serial    =++g_residentSerial;
+    m_resident.uploads.clear();
+
+    for(size_t i=0; i < m_cache.size(); ++i){
+      CacheEntry &ce=m_cache[i];
+      if( !ce.resident && ce.vertCount )
+        make_resident(ce);
+    }
+    build_resident_draws();
+  }
+  //--------------------------------------------------------------------------//
+  /// Gives \a ce its place in m_residentPool. Adjacent uploads are merged,
+  /// consecutive allocations usually are.
+  //--------------------------------------------------------------------------//
+  void Font::make_resident(CacheEntry &ce){
+    // Whole quads, so every allocation is a multiple of both kAlignment
+    // and sizeof(Vertex).
+    const size_t bytes=ce.vertCount*sizeof(Vertex);
+    if( m_residentPool.largest() < bytes ){
+      if( m_residentPool.available() >= std::max(bytes,
+                                                 m_residentPool.size()/4) )
+        defragment_resident();
+      else
+        grow_resident(bytes);
+    }
+
+    ce.resident=(Vertex*)m_residentPool.alloc(bytes);
+    if( !( ce.pageMask & (ce.pageMask-1) ) )
+      std::copy(ce.verts, ce.verts + ce.vertCount, ce.resident);
+    else{
+      // On several pages, one Draw per page needs each page's quads
+      // together.
+      Vertex *dst=ce.resident;
+      for(uint32_t page=0, mask=ce.pageMask; mask; ++page, mask>>=1){
+        for(size_t q=0; mask & 1 && q < ce.vertCount/4; ++q){
+          if( ce.pages[q] == page ){
+            std::copy_n(&ce.verts[q*4], 4, dst);
+            dst+=4;
+          }
+        }
+      }
+    }
+
+    const size_t off=ce.resident - m_resident.vb;
+    std::vector<Chunk> &uploads=m_resident.uploads;
+    if( !uploads.empty() && uploads.back().off+uploads.back().size == off )
+      uploads.back().size+=ce.vertCount;
+    else
+      uploads.push_back( Chunk(off, ce.vertCount) );
+  }
+  //--------------------------------------------------------------------------//
+  /// Moves the resident entries to the front of m_residentPool, all of
+  /// them have to be uploaded again.
+  //--------------------------------------------------------------------------//
+  void Font::defragment_resident(){
+    std::list<MemAddr2> moves;
+    m_residentPool.defragment(moves);
+
+    // The moves are in address order, match them with the entries sorted
+    // the same way.
+    std::vector<CacheEntry*> entries;
+    for(size_t i=0; i < m_cache.size(); ++i){
+      if( m_cache[i].resident )
+        entries.push_back(&m_cache[i]);
+    }
+    std::sort(entries.begin(), entries.end(), ByResidentAddress());
+
+    std::list<MemAddr2>::const_iterator move=moves.begin();
+    for(size_t i=0; i < entries.size() && move != moves.end(); ++i){
+      if( entries[i]->resident == move->x ){
+        entries[i]->resident=(Vertex*)move->y;
+        ++move;
+      }
+    }
+
+    const size_t used=m_residentPool.size() - m_residentPool.available();
+    m_resident.uploads.clear();
+    if( used )
+      m_resident.uploads.push_back( Chunk(0, used/sizeof(Vertex)) );
+  }
+  //--------------------------------------------------------------------------//
+  /// Reallocates m_residentPool with room for \a bytes more, at least
+  /// twice as big. The resident entries are copied again from their verts.
+  //--------------------------------------------------------------------------//
+  void Font::grow_resident(size_t bytes){
+    const size_t used=m_residentPool.size() - m_residentPool.available();
+    size_t capacity=( m_resident.capacity ? m_resident.capacity*2
+                                          : kResidentQuads*4 );
+    while( capacity*sizeof(Vertex) < used + bytes )
+      capacity*=2;
+
+    m_residentPool.init(capacity*sizeof(Vertex));
+    m_resident.vb      =(const Vertex*)m_residentPool.data();
+    m_resident.capacity=capacity;
+    m_resident.uploads.clear();
+    for(size_t i=0; i < m_cache.size(); ++i){
+      CacheEntry &ce=m_cache[i];
+      if( ce.resident ){
+        ce.resident=NULL;
+        make_resident(ce);
+      }
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// Fills m_resident.draws with the prints of the last frame, one Draw per
+  /// print and atlas page.
+  //--------------------------------------------------------------------------//
+  void Font::build_resident_draws(){
+    const IGlyphAtlas *atlas=m_face->atlas();
+    const size_t      pages=atlas->pages();
+    std::vector<Draw> &draws=m_resident.draws;
+    draws.clear();
+    for(Instances::const_iterator i=m_drawn.begin(); i != m_drawn.end(); ++i){
+      const CacheEntry &ce=m_cache[i->entry];
+      if( !ce.resident )
+        continue;
+
+      const bool  single=!( ce.pageMask & (ce.pageMask-1) );
+      size_t      first =(ce.resident - m_resident.vb) / 2;
+      for(uint32_t page=0, mask=ce.pageMask; mask; ++page, mask>>=1){
+        if( !(mask & 1) )
+          continue;
+        size_t quads=ce.vertCount/4;
+        if( !single )
+          quads=std::count(ce.pages, ce.pages + ce.vertCount/4, page);
+
+        // A page the atlas does not have any more, see get_geometry().
+        if( page < pages ){
+          Draw draw={ { atlas->texid(page), atlas->channel(), first, quads*2 },
+                      i->position };
+          draws.push_back(draw);
+        }
+        first+=quads*2;
+      }
+    }
+  }
+  //--------------------------------------------------------------------------//
+  /// Records a print of \a ce at m_position, drawn after the next
+  /// update_cache().
+  //--------------------------------------------------------------------------//
+  void Font::add_instance(const CacheEntry *ce){
+    Instance instance={ (uint32_t)(ce - &m_cache[0]), m_position };
+    m_printed.push_back(instance);
+  }
 }
@@ -10,7 +10,12 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 */
 //======================================================================
 #include "nFontFace.hpp"
-#include "nGLGlyphAtlas.hpp"
+#include "nGlyphTable.hpp"
+#include "nGlyphRasterizer.hpp"
+#include "nGlyphCache.hpp"
+#include "nFontFile.hpp"
+#include "nGlyphSDF.hpp"
+#include "nAtlasRepacker.hpp"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -18,30 +23,167 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #include FT_GLYPH_H
 #include FT_TRIGONOMETRY_H
 
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include <unordered_set>
+
 namespace ngl{
   namespace freetype{
+    const FT_UInt   kDPI        =96;
+    const FT_Int32  kLoadFlags  =FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT;
+
     const FT_Library& handle();
+    bool open_face(FT_Library lib, const String &face, size_t size,
+                   FT_Face &out);
+    bool load_glyph(FT_Face face, Codepoint code, RasterGlyph &out);
+    void copy_bitmap(FT_Face face, byte *dst, size_t pitch);
+    bool rasterize(FT_Face face, Codepoint code, RasterGlyph &out);
+    uint2 max_size(FT_Face face);
+  }
+
+  namespace{
+    //------------------------------------------------------------------------//
+    /// Where \a glyph is now, for an AtlasLayout.
+    //------------------------------------------------------------------------//
+    AtlasTransfer to_transfer(Glyph &glyph, const Size2 &page){ //{{{
+      AtlasTransfer t;
+      t.glyph   =&glyph;
+      t.size    =glyph.size;
+      t.srcPage =glyph.page;
+      t.src.set( (uint32_t)lroundf(glyph.botLeft.u * page.width),
+                 (uint32_t)lroundf(glyph.botLeft.v * page.height) );
+      t.dstPage =0;
+      return t;
+    }//}}}
+  }
+
+  namespace{
+    //------------------------------------------------------------------------//
+    /// Atlas a face with the given FaceFlags keeps its glyphs in.
+    //------------------------------------------------------------------------//
+    AtlasType atlas_type(uint32_t flags){ //{{{
+      if( flags & FaceFlags::Headless )
+        return Atlas::Memory;
+      return ( flags & FaceFlags::Shared ? Atlas::Channel : Atlas::GL );
+    }//}}}
   }
 
   struct FontFace::Pimpl{
-    FT_Face       ftFace;
-    Glyphs        glyphs;
+    FT_Face           ftFace;
+    Glyphs            glyphs;
+    GlyphTable        table;
+    GlyphRasterizer   *rasterizer;
+    Glyph             placeholder;  // table entry for glyphs being loaded.
+    Glyph             missing;      // table entry for glyphs the atlas
+                                    // had no room for.
+    std::vector<Codepoint>  missingCodes; // retried after an eviction.
+    std::vector<Glyph*>     freeGlyphs;   // slots of evicted glyphs.
+    std::vector<uint32_t>   pageUsed;     // frame each atlas page was last
+                                          // drawn in.
+    uint32_t          frame;        // frames printed so far.
+    bool              frameEnded;   // update() ran since the frame began.
+    size_t            frameUploaded;  // atlas uploaded() when it began.
+    uint32_t          epoch;        // evictions and repacks so far.
+    size_t            budget;       // atlas page limit, 0 if unbounded.
+    AtlasRepacker     repacker;     // plans defragment() layouts.
+    uint32_t          repackEpoch;  // epoch the planned layout started at.
+    GlyphCache        cache;        // mapped on-disk glyph cache.
+    GlyphCacheKey     cacheKey;
+    bool              useCache;
+    RasterGlyphs      uncached;     // glyphs loaded that are not in cache.
+    size_t            sdfSpread;    // 0 unless the face is an SDF face.
+
+    bool          rasterize(Codepoint code, RasterGlyph &out);
+    Glyph&        alloc_glyph();
+    const Glyph&  mark_missing(Codepoint code);
+    void          retry_missing();
+    void          touch(uint32_t page);
+    void          begin_frame(const IGlyphAtlas &atlas);
   };
 
 
 
   //--------------------------------------------------------------------------//
-  //{{{ FontFace(const String &face, size_t size)
+  //{{{ FontFace(const String &face, size_t size, uint32_t flags)
   /// \brief  Default constructor.
+  ///   \param[in]  flags   FaceFlags::SDF makes this a distance field face,
+  ///                       FaceFlags::Headless keeps the glyphs in memory
+  ///                       only, FaceFlags::Shared in a channel of a
+  ///                       texture shared with other faces. The other
+  ///                       flags are handled by faces::acquire().
   //--------------------------------------------------------------------------//
-  FontFace::FontFace(const String &face, size_t size)
+  FontFace::FontFace(const String &face, size_t size, uint32_t flags)
   :d(new Pimpl){
 
-    d->ftFace = nullptr;
-    m_atlas=new GLGlyphAtlas(128,128);
+    d->ftFace       = nullptr;
+    d->rasterizer   = nullptr;
+    d->placeholder  = Glyph::pending;
+    d->missing      = Glyph::null;
+    d->frame        = 1;
+    d->frameEnded   = false;
+    d->frameUploaded= 0;
+    d->epoch        = 0;
+    d->budget       = 0;
+    d->repackEpoch  = 0;
+    d->useCache     = false;
+    d->sdfSpread    = ( flags & FaceFlags::SDF ? sdf::kSpread : 0 );
+    // Distance fields are sampled with linear filtering, and are much
+    // bigger: padded by the spread and rendered at the reference size.
+    AtlasType type=atlas_type(flags);
+    if( d->sdfSpread )
+      m_atlas=create_atlas(type, 512, 512, true);
+    else
+      m_atlas=create_atlas(type, 256, 256);
     load(face, size);
   }
   //}}}-----------------------------------------------------------------------//
+  //{{{ FontFace(const BakedFont &font, size_t size, uint32_t flags)
+  /// \brief  Creates the face from a font baked with nfonts_bake.
+  ///
+  /// All the glyphs are added to the atlas up front. FreeType is not used
+  /// (and does not have to be initialized), so get_glyph returns Glyph::null
+  /// for anything that was not baked.
+  ///   \param[in]  font    Baked font, only used during construction.
+  ///   \param[in]  size    Size in pt, has to be one of the baked sizes.
+  ///   \param[in]  flags   FaceFlags::Headless and FaceFlags::Shared pick
+  ///                       the atlas, the other flags are ignored.
+  //--------------------------------------------------------------------------//
+  FontFace::FontFace(const BakedFont &font, size_t size, uint32_t flags)
+  :d(new Pimpl){
+
+    d->ftFace       = nullptr;
+    d->rasterizer   = nullptr;
+    d->placeholder  = Glyph::pending;
+    d->missing      = Glyph::null;
+    d->frame        = 1;
+    d->frameEnded   = false;
+    d->frameUploaded= 0;
+    d->epoch        = 0;
+    d->budget       = 0;
+    d->repackEpoch  = 0;
+    d->useCache     = false;
+    d->sdfSpread    = 0;
+    AtlasType type=atlas_type(flags);
+    m_atlas=create_atlas(type, 256, 256);
+    m_name=font.name();
+    m_size=size;
+    m_maxSize.set(0, 0);
+
+    const BakedFont::Face *face=font.find(size);
+    if( !face ){
+      fprintf(stderr, "%s: no %upt face baked.\n",
+              font.name().c_str(), (unsigned)size);
+      return;
+    }
+    m_maxSize.set(face->maxWidth, face->maxHeight);
+
+    if( d->cache.attach(font.image(*face), face->size) )
+      add_cached_glyphs();
+    d->cache.close();
+  }
+  //}}}-----------------------------------------------------------------------//
   //{{{ FontFace(const FontFace &obj)
   /// \brief  Copy constructor.
   ///   \param[in]  obj   FontFace to copy from.
@@ -51,6 +193,8 @@ namespace ngl{
   //}}}-----------------------------------------------------------------------//
   //{{{ ~FontFace()
   FontFace::~FontFace(){
+    delete d->rasterizer;
+    save_cache();
     FT_Done_Face(d->ftFace);
     delete d;
     delete m_atlas;
@@ -78,19 +222,114 @@ namespace ngl{
     return m_maxSize;
   }
   //}}}-----------------------------------------------------------------------//
-  size_t FontFace::text_width(const String &text){ //{{{
+  //{{{ bool is_sdf() const
+  /// \returns
+  ///   True if the glyphs are distance fields, to be drawn with alpha test
+  ///   and linear filtering at any size.
+  //--------------------------------------------------------------------------//
+  bool FontFace::is_sdf() const{
+    return d->sdfSpread != 0;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void set_budget(size_t pages)
+  /// Bounds the atlas to \a pages textures. Once they are full, the least
+  /// recently drawn page is cleared to make room, see evict(). One more
+  /// page is used if a single frame draws from all of them.
+  ///   \param[in]  pages   Page limit, 0 to let the atlas grow (the
+  ///                       default).
+  //--------------------------------------------------------------------------//
+  void FontFace::set_budget(size_t pages){
+    d->budget=pages;
+    m_atlas->set_page_limit(pages);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void touch_pages(uint32_t pageMask)
+  /// Marks atlas pages as drawn in the current frame, for geometry that
+  /// was built before (Font's cache) and does not go through get_glyph().
+  ///   \param[in]  pageMask    Bit n set for page n.
+  //--------------------------------------------------------------------------//
+  void FontFace::touch_pages(uint32_t pageMask){
+    d->begin_frame(*m_atlas);
+    if( !d->budget )
+      return;
+    for(uint32_t page=0; pageMask; ++page, pageMask>>=1){
+      if( pageMask & 1 )
+        d->touch(page);
+    }
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ uint32_t epoch() const
+  /// \returns
+  ///   Number of evictions and repacks so far. Geometry built with an
+  ///   older epoch may refer to glyphs that are not in the atlas any more,
+  ///   or have moved.
+  //--------------------------------------------------------------------------//
+  uint32_t FontFace::epoch() const{
+    return d->epoch;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool defragment()
+  /// Starts planning a compact atlas layout on a worker thread. Evictions
+  /// leave the pages full of gaps the packer can not reuse; the new layout
+  /// packs all glyphs again, tallest first, into as few pages as possible.
+  /// It is applied by a later update(), in one go: the glyph bitmaps are
+  /// moved, the glyphs get their new texture coordinates, every page is
+  /// uploaded once and epoch() changes, so Fonts rebuild their geometry.
+  /// A plan is dropped if a page gets evicted before it is ready.
+  /// \returns
+  ///   false if a layout is already being planned.
+  //--------------------------------------------------------------------------//
+  bool FontFace::defragment(){
+    if( d->repacker.busy() )
+      return false;
+
+    const Size2 &page=m_atlas->size();
+    std::vector<AtlasTransfer> transfers;
+    for(Glyphs::iterator it=d->glyphs.begin(); it != d->glyphs.end(); ++it){
+      if( !it->owner )
+        continue;
+      transfers.push_back( to_transfer(*it, page) );
+    }
+    d->repackEpoch=d->epoch;
+    return d->repacker.start(transfers, page, m_atlas->pages());
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t memory_usage() const
+  /// \returns
+  ///   Approximate memory held by the face: atlas texels, glyphs and the
+  ///   lookup table. FreeType's own allocations are not included.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::memory_usage() const{
+    const Size2 &atlas=m_atlas->size();
+    return sizeof(FontFace) + sizeof(Pimpl)
+         + atlas.width * atlas.height * m_atlas->pages()
+         + d->glyphs.size() * sizeof(Glyph)
+         + d->table.pages() * GlyphTable::kPageSize * sizeof(Glyph*);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t text_width(const String &text, float scale)
+  ///   \param[in]  scale   Applied to every advance, like Font does: the
+  ///                       Font size over size() (SDF faces are shared by
+  ///                       all sizes).
+  /// \returns
+  ///   Width of the widest line of \a text, in pixels.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::text_width(const String &text, float scale){
     size_t      maxWidth=0;
     size_t      width=0;
+    const char  *str=text.c_str();
+    const char  *end=str+text.length();
 
-    for(String::size_type i=0; i < text.length(); ++i){
-      if(text[i]=='\n'){
+    while( str < end ){
+      Codepoint code=utf8_decode(str, end);
+      if(code=='\n'){
         if(width > maxWidth)
           maxWidth=width;
         width=0;
         continue;
       }
-      const Glyph &glyph =get_glyph(text[i]);
-      width+=glyph.advance;
+      const Glyph &glyph =get_glyph(code);
+      width+=lroundf(glyph.advance * scale);
     }
     if(width > maxWidth)
       maxWidth=width;
@@ -98,18 +337,29 @@ namespace ngl{
     return maxWidth;
   }
   //}}}-----------------------------------------------------------------------//
-  //{{{ size_t split( text, width,lines, wrapMode )
+  //{{{ size_t split( text, width,lines, wrapMode, scale )
+  ///   \param[in]  scale   See text_width().
+  //--------------------------------------------------------------------------//
   size_t FontFace::split(const String &text,
                          size_t width,
                          StringList &lines,
-                         TextWrapMode wrapMode){
+                         TextWrapMode wrapMode,
+                         float scale){
     size_t            off=0;
     String::size_type lineStart=0;
     String::size_type lastSpace=0;
     size_t            lastWordWidth=0;
+    const char        *str=text.c_str();
+    const char        *end=str+text.length();
 
-    for(String::size_type i=0; i<text.length(); ++i){
-      if( text[i]=='\n' ){
+    // i is a byte offset, so the substr() calls below never cut a sequence.
+    String::size_type next=0;
+    for(String::size_type i=0; i<text.length(); i=next){
+      const char  *cur  =str+i;
+      Codepoint   code  =utf8_decode(cur, end);
+      next=cur-str;
+
+      if( code=='\n' ){
         if( i==lineStart )
           lines.push_back(String("\n"));
         else
@@ -120,20 +370,20 @@ namespace ngl{
         continue;
       }
 
-      const Glyph &glyph =get_glyph(text[i]);
+      const size_t advance=lroundf(get_glyph(code).advance * scale);
       if( wrapMode==TextWrap::LineWrap ){
-        if( off + glyph.advance > width ){
+        if( off + advance > width ){
           lines.push_back(text.substr(lineStart, i-lineStart)+'\n');
           lineStart=i;
           off=0;
         }
       }
       else if( wrapMode==TextWrap::WordWrap ){
-        if( text[i]==' ' || text[i]=='\t' ){
+        if( code==' ' || code=='\t' ){
           lastSpace=i;
           lastWordWidth=0;
         }
-        if(off + glyph.advance > width){
+        if(off + advance > width){
           if( lastSpace > lineStart ){
             lines.push_back( text.substr( lineStart, 
                                           lastSpace-lineStart)+'\n' );
@@ -147,9 +397,9 @@ namespace ngl{
             off=0;
           }
         }
-        lastWordWidth+=glyph.advance;
+        lastWordWidth+=advance;
       }
-      off+=glyph.advance;
+      off+=advance;
     }
     if( off > 0 )
       lines.push_back(text.substr(lineStart)+ '\n');
@@ -157,54 +407,509 @@ namespace ngl{
     return off;
   }
   //}}}-----------------------------------------------------------------------//
-  const Glyph& FontFace::get_glyph(char code){ //{{{
+  const Glyph& FontFace::get_glyph(Codepoint code){ //{{{
+    d->begin_frame(*m_atlas);
+    // Check if the glyph is already loaded (or already requested).
+    const Glyph *found=d->table.find(code);
+    if( found ){
+      if( d->budget && found->owner )
+        d->touch(found->page);
+      return *found;
+    }
+
     if( !d->ftFace )
       return Glyph::null;
 
-    bool isTab = false;
-    if( code == '\t' ){
-      code  =' ';
-      isTab =true;
+    if( d->rasterizer ){
+      // Rasterized in the background, picked up by update().
+      d->rasterizer->request(code);
+      d->table.insert(code, &d->placeholder);
+      return d->placeholder;
+    }
+
+    //  Glyph not found, load it.
+    if( !d->sdfSpread )
+      return load_glyph(code);
+
+    RasterGlyph raster;
+    if( !d->rasterize(code, raster) )
+      return Glyph::null;
+
+    return insert_glyph(raster);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const Glyph& find_glyph(Codepoint code) const
+  /// Looks \a code up without loading it or marking its page as drawn.
+  /// \returns
+  ///   The glyph, Glyph::null if it can not be loaded, Glyph::pending if
+  ///   it is not in the atlas.
+  //--------------------------------------------------------------------------//
+  const Glyph& FontFace::find_glyph(Codepoint code) const{
+    const Glyph *found=d->table.find(code);
+    return ( found ? *found : Glyph::pending );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void set_async(size_t numThreads)
+  /// Switches between synchronous and background glyph loading.
+  ///
+  /// In async mode get_glyph() returns Glyph::pending for glyphs that are
+  /// not loaded yet, and the glyphs get added to the atlas by update().
+  ///   \param[in]  numThreads  Number of worker threads, 0 to load glyphs
+  ///                           synchronously (the default).
+  //--------------------------------------------------------------------------//
+  void FontFace::set_async(size_t numThreads){
+    if( d->rasterizer ){
+      // Finish whatever is in flight, the placeholders have to go.
+      while( d->rasterizer->pending() ){
+        update();
+        std::this_thread::yield();
+      }
+      delete d->rasterizer;
+      d->rasterizer=NULL;
     }
 
-    // Check if the glyph is already loaded.
-    for(Glyphs::iterator it=d->glyphs.begin(); it!=d->glyphs.end(); ++it){
-      if(it->code==code){
-        return *it;
+    if( numThreads && d->ftFace ){
+      d->rasterizer=new GlyphRasterizer(m_name, m_size, numThreads,
+                                        d->sdfSpread);
+      // No worker could open the face, nothing would ever be served.
+      if( !d->rasterizer->threads() ){
+        fprintf(stderr, "%s: no glyph worker started, loading glyphs "
+                        "synchronously.\n", m_name.c_str());
+        delete d->rasterizer;
+        d->rasterizer=NULL;
       }
     }
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t pending() const
+  /// \returns
+  ///   Number of glyphs requested in async mode that are not in the atlas
+  ///   yet.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::pending() const{
+    return (d->rasterizer ? d->rasterizer->pending() : 0);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t uploaded() const
+  /// \returns
+  ///   Bytes of glyph bitmaps sent to the GPU in the current frame; after
+  ///   update(), in the frame it ended. Every Font sharing the face sees
+  ///   the same count.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::uploaded() const{
+    return m_atlas->uploaded() - d->frameUploaded;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void update()
+  /// Adds the glyphs finished by the background workers to the atlas and
+  /// uploads all glyphs loaded since the last call, in one texture update.
+  /// Has to be called from the thread owning the GL context, once per frame
+  /// before drawing (Font::update_cache does). It also ends the frame for
+  /// set_budget(): the pages drawn in it are not evicted, by this call or
+  /// by the updates of other Fonts sharing the face, until the next frame
+  /// starts printing.
+  //--------------------------------------------------------------------------//
+  void FontFace::update(){
+    if( d->budget )
+      d->retry_missing();
+    RasterGlyphs done;
+    if( d->rasterizer && d->rasterizer->collect(done) )
+      insert_glyphs(done);
+    if( d->repacker.busy() )
+      apply_layout();
 
-    //  Glyph not found, load it.
-    if( FT_Load_Char( d->ftFace, code,
-                      FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT) ){
-      fprintf(stderr, "FT_Load_Char failed.\n");
-      return Glyph::null;
+    m_atlas->flush();
+    d->frameEnded=true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t preload(const String &charset, size_t numThreads)
+  /// Loads all glyphs of \a charset (UTF-8) and adds them to the atlas in a
+  /// single batch.
+  ///
+  /// Large sets are rasterized by a temporary pool of worker threads, small
+  /// ones on the calling thread. Either way the call returns once all the
+  /// glyphs are in the atlas, so it has to be made from the GL thread.
+  ///   \param[in]  charset     Characters to load, duplicates are fine.
+  ///   \param[in]  numThreads  Worker threads, 0 picks one per core.
+  /// \returns
+  ///   Number of glyphs loaded.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::preload(const String &charset, size_t numThreads){
+    // Glyphs per worker below which threads cost more than they save.
+    const size_t kMinGlyphsPerThread=32;
+
+    if( !d->ftFace )
+      return 0;
+
+    std::vector<Codepoint>  codes;
+    const char              *str=charset.c_str();
+    const char              *end=str+charset.length();
+    while( str < end ){
+      Codepoint code=utf8_decode(str, end);
+      if( !d->table.find(code) )
+        codes.push_back(code);
     }
-    // shortcut
-    FT_Bitmap &bitmap = d->ftFace->glyph->bitmap;
+    std::sort(codes.begin(), codes.end());
+    codes.erase( std::unique(codes.begin(), codes.end()), codes.end() );
+    if( codes.empty() )
+      return 0;
+
+    if( !numThreads )
+      numThreads=std::thread::hardware_concurrency();
+    if( numThreads > codes.size() / kMinGlyphsPerThread )
+      numThreads=codes.size() / kMinGlyphsPerThread;
 
-    byte *pixels = new byte[bitmap.width * bitmap.rows];
-    for(int y = 0; y < bitmap.rows; ++y){
-      memcpy( pixels + y * bitmap.width,
-              bitmap.buffer + (bitmap.rows - y - 1)* bitmap.pitch,
-              bitmap.width);
+    RasterGlyphs rasters;
+    if( numThreads > 1 ){
+      GlyphRasterizer pool(m_name, m_size, numThreads, d->sdfSpread);
+      for(size_t i=0; pool.threads() && i < codes.size(); ++i)
+        pool.request(codes[i]);
+      pool.wait();
+      pool.collect(rasters);
     }
+    if( rasters.empty() ){
+      rasters.resize(codes.size());
+      for(size_t i=0; i < codes.size(); ++i)
+        d->rasterize(codes[i], rasters[i]);
+    }
+
+    return insert_glyphs(rasters);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t insert_glyphs(const RasterGlyphs &rasters)
+  /// Adds rasterized glyphs to the atlas (as a single batch) and the lookup
+  /// table. Glyphs that failed to load are looked up as Glyph::null from
+  /// then on, they are not requested again.
+  /// \returns
+  ///   Number of glyphs added.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::insert_glyphs(const RasterGlyphs &rasters){
+    std::vector<AtlasEntry> entries;
+    entries.reserve(rasters.size());
+    for(size_t i=0; i < rasters.size(); ++i){
+      const RasterGlyph &raster=rasters[i];
+      if( !raster.loaded ){
+        d->table.insert(raster.code, &d->missing);
+        continue;
+      }
+
+      Glyph &glyph  =d->alloc_glyph();
+      glyph.code    =raster.code;
+      glyph.size    =raster.size;
+      glyph.off     =raster.off;
+      glyph.advance =raster.advance;
+
+      AtlasEntry entry;
+      entry.glyph =&glyph;
+      entry.data  =raster.pixels.data();
+      entry.size  =raster.size;
+      entries.push_back(entry);
+
+      if( d->useCache )
+        d->uncached.push_back(raster);
+    }
+    return add_to_atlas(entries);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t add_to_atlas(std::vector<AtlasEntry> &entries)
+  /// Uploads the glyphs of \a entries in a single batch and makes them
+  /// visible to get_glyph. Glyphs the atlas had no room for are looked up
+  /// as Glyph::null from then on.
+  /// \returns
+  ///   Number of glyphs added.
+  //--------------------------------------------------------------------------//
+  size_t FontFace::add_to_atlas(std::vector<AtlasEntry> &entries){
+    if( entries.empty() )
+      return 0;
+
+    m_atlas->add_batch(&entries[0], entries.size());
+    // Keep the pages the batch went to from being evicted to make room
+    // for the rest.
+    for(size_t i=0; i < entries.size(); ++i){
+      if( entries[i].glyph->owner )
+        d->touch(entries[i].glyph->page);
+    }
+
+    size_t added=0;
+    for(size_t i=0; i < entries.size(); ++i){
+      Glyph *glyph=entries[i].glyph;
+      if( !glyph->owner && !add_glyph(*glyph, entries[i].data) ){
+        d->mark_missing(glyph->code);
+        d->freeGlyphs.push_back(glyph);
+        continue;
+      }
+      d->table.insert(glyph->code, glyph);
+      ++added;
+    }
+    m_atlas->flush();
+    return added;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool add_glyph(Glyph &glyph, const byte *data)
+  /// Adds a \a glyph.size bitmap to the atlas, evicting old pages if the
+  /// face has a budget and the atlas is full. If all the pages are being
+  /// drawn in the current frame, the atlas may grow one page past the
+  /// budget instead.
+  //--------------------------------------------------------------------------//
+  bool FontFace::add_glyph(Glyph &glyph, const byte *data){
+    const Size2 &page=m_atlas->size();
+    if( glyph.size.width > page.width || glyph.size.height > page.height )
+      return false;
+
+    while( m_atlas->add(glyph, data, glyph.size) ){
+      if( evict() )
+        continue;
 
+      Error err=ENotEnoughMemory;
+      if( d->budget && m_atlas->pages() == d->budget ){
+        m_atlas->set_page_limit(d->budget+1);
+        err=m_atlas->add(glyph, data, glyph.size);
+        m_atlas->set_page_limit(d->budget);
+      }
+      if( err ){
+        fprintf(stderr, "%s: no room for glyph U+%04X in the atlas.\n",
+                m_name.c_str(), glyph.code);
+        return false;
+      }
+      break;
+    }
+    d->touch(glyph.page);
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool evict()
+  /// Clears the least recently drawn atlas page, if there is one that was
+  /// not drawn in the current frame. Its glyphs are loaded again the
+  /// next time they are needed, and epoch() changes so Fonts drop the
+  /// geometry they have cached.
+  /// \returns
+  ///   false if there is no budget or no page can be evicted.
+  //--------------------------------------------------------------------------//
+  bool FontFace::evict(){
+    if( !d->budget )
+      return false;
+
+    size_t    victim=kInvalidIndex;
+    uint32_t  oldest=d->frame;
+    for(size_t p=0; p < m_atlas->pages(); ++p){
+      uint32_t used=( p < d->pageUsed.size() ? d->pageUsed[p] : 0 );
+      if( used < oldest ){
+        oldest=used;
+        victim=p;
+      }
+    }
+    if( victim == kInvalidIndex || !m_atlas->clear_page(victim) )
+      return false;
+
+    for(Glyphs::iterator it=d->glyphs.begin(); it != d->glyphs.end(); ++it){
+      if( it->owner && it->page == victim ){
+        d->table.insert(it->code, NULL);
+        it->owner=NULL;
+        d->freeGlyphs.push_back(&*it);
+      }
+    }
+    d->retry_missing();
+    ++d->epoch;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool apply_layout()
+  /// Applies the layout planned by defragment(), once it is ready. Glyphs
+  /// added to the atlas since the plan was started are packed after the
+  /// others.
+  /// \returns
+  ///   true if the atlas was repacked.
+  //--------------------------------------------------------------------------//
+  bool FontFace::apply_layout(){
+    AtlasLayout layout;
+    if( !d->repacker.collect(layout) || layout.pages.empty()
+        || d->repackEpoch != d->epoch )
+      return false;
+
+    std::unordered_set<const Glyph*> planned;
+    for(size_t i=0; i < layout.transfers.size(); ++i)
+      planned.insert(layout.transfers[i].glyph);
+
+    const Size2 &page=m_atlas->size();
+    for(Glyphs::iterator it=d->glyphs.begin(); it != d->glyphs.end(); ++it){
+      if( !it->owner || planned.count(&*it) )
+        continue;
+      AtlasTransfer t=to_transfer(*it, page);
+      if( !layout.add(t) )
+        return false;
+      layout.transfers.push_back(t);
+    }
+    if( !m_atlas->repack(layout) )
+      return false;
+
+    // Which glyph is drawn from which page is not known any more.
+    d->pageUsed.assign(m_atlas->pages(), d->frame);
+    ++d->epoch;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void load_cache()
+  /// Fills the atlas from the on-disk glyph cache, if there is one matching
+  /// this face. The bitmaps are uploaded straight from the mapped file.
+  //--------------------------------------------------------------------------//
+  void FontFace::load_cache(){
+    if( !glyphcache::enabled() )
+      return;
+
+    memset(&d->cacheKey, 0, sizeof(d->cacheKey));
+    if( !glyphcache::hash_file(m_name, d->cacheKey) )
+      return;
+    d->cacheKey.pointSize =m_size;
+    d->cacheKey.dpi       =freetype::kDPI;
+    d->cacheKey.loadFlags =freetype::kLoadFlags;
+    d->cacheKey.sdfSpread =d->sdfSpread;
+    d->useCache           =true;
+
+    // On any mismatch we just start with an empty atlas, the file gets
+    // replaced when the face is destroyed.
+    if( !d->cache.open(glyphcache::file_name(m_name, d->cacheKey),
+                       d->cacheKey) )
+      return;
+
+    add_cached_glyphs();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void add_cached_glyphs()
+  /// Adds all the glyphs of the open cache to the atlas, in one batch.
+  //--------------------------------------------------------------------------//
+  void FontFace::add_cached_glyphs(){
+    std::vector<AtlasEntry> entries(d->cache.size());
+    for(size_t i=0; i < d->cache.size(); ++i){
+      const GlyphCache::Record &rec=d->cache.record(i);
+
+      Glyph &glyph  =d->alloc_glyph();
+      glyph.code    =rec.code;
+      glyph.size.set(rec.width, rec.height);
+      glyph.off.set(rec.offX, rec.offY);
+      glyph.advance =rec.advance;
+
+      entries[i].glyph  =&glyph;
+      entries[i].data   =d->cache.bitmap(rec);
+      entries[i].size   =glyph.size;
+    }
+    add_to_atlas(entries);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool save_cache()
+  /// Writes the glyph cache file, if glyphs were loaded since it was read.
+  /// Called automatically by the destructor.
+  /// \returns
+  ///   false if the cache is disabled or could not be written.
+  //--------------------------------------------------------------------------//
+  bool FontFace::save_cache(){
+    if( !d->useCache )
+      return false;
+    if( d->uncached.empty() )
+      return true;
+
+    std::vector<GlyphCache::Record> records;
+    std::vector<const byte*>        bitmaps;
+    std::unordered_set<Codepoint>   saved;
+    for(size_t i=0; i < d->cache.size(); ++i){
+      records.push_back( d->cache.record(i) );
+      bitmaps.push_back( d->cache.bitmap(d->cache.record(i)) );
+      saved.insert( d->cache.record(i).code );
+    }
+    // Glyphs of evicted pages are rasterized and queued again; a code goes
+    // in once, from its last raster, and not at all if the file has it.
+    std::vector<size_t> added;
+    for(size_t i=d->uncached.size(); i-- > 0; ){
+      if( saved.insert(d->uncached[i].code).second )
+        added.push_back(i);
+    }
+    if( added.empty() ){
+      d->uncached.clear();
+      return true;
+    }
+    for(size_t i=added.size(); i-- > 0; ){
+      const RasterGlyph   &raster=d->uncached[ added[i] ];
+      GlyphCache::Record  rec;
+      rec.code        =raster.code;
+      rec.width       =raster.size.width;
+      rec.height      =raster.size.height;
+      rec.offX        =raster.off.x;
+      rec.offY        =raster.off.y;
+      rec.advance     =raster.advance;
+      rec.dataOffset  =0;
+      records.push_back(rec);
+      bitmaps.push_back(raster.pixels.data());
+    }
+
+    if( !GlyphCache::write(glyphcache::file_name(m_name, d->cacheKey),
+                           d->cacheKey, records, bitmaps) )
+      return false;
+
+    d->uncached.clear();
+    // Keep serving the bitmaps from the new file.
+    d->cache.open(glyphcache::file_name(m_name, d->cacheKey), d->cacheKey);
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const Glyph& insert_glyph(const RasterGlyph &raster)
+  /// Adds a rasterized glyph to the atlas and the lookup table.
+  /// \returns
+  ///   The glyph, or Glyph::null if the atlas has no room for it.
+  //--------------------------------------------------------------------------//
+  const Glyph& FontFace::insert_glyph(const RasterGlyph &raster){
     Glyph glyph;
-    glyph.size.set(bitmap.width, bitmap.rows);
-    glyph.code    = (isTab ? '\t' : code );
-    glyph.advance = (d->ftFace->glyph->advance.x >> 6);
-    glyph.off.x   = 0;
-    glyph.off.x   = ( d->ftFace->glyph->metrics.horiBearingX >> 6 )
-                    - ( d->ftFace->glyph->metrics.width >> 6 );
-    glyph.off.y   = ( d->ftFace->glyph->metrics.horiBearingY >> 6 )
-                    - ( d->ftFace->glyph->metrics.height >> 6 );
-    m_atlas->add(glyph, pixels, glyph.size);
-    d->glyphs.push_back(glyph);
+    glyph.code    = raster.code;
+    glyph.size    = raster.size;
+    glyph.off     = raster.off;
+    glyph.advance = raster.advance;
+    if( !add_glyph(glyph, raster.pixels.data()) )
+      return d->mark_missing(glyph.code);
 
-    delete[] pixels;
+    Glyph &slot=d->alloc_glyph();
+    slot=glyph;
+    d->table.insert(glyph.code, &slot);
+    if( d->useCache )
+      d->uncached.push_back(raster);
 
-    return d->glyphs.back();
+    return slot;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const Glyph& load_glyph(Codepoint code)
+  /// Renders a glyph straight into the atlas memory, without any
+  /// intermediate bitmap (unless it has to be kept for the glyph cache).
+  //--------------------------------------------------------------------------//
+  const Glyph& FontFace::load_glyph(Codepoint code){
+    RasterGlyph raster;
+    if( !freetype::load_glyph(d->ftFace, code, raster) )
+      return Glyph::null;
+
+    Glyph glyph;
+    glyph.code    = raster.code;
+    glyph.size    = raster.size;
+    glyph.off     = raster.off;
+    glyph.advance = raster.advance;
+
+    size_t  pitch;
+    byte    *dst=m_atlas->reserve(glyph, glyph.size, pitch);
+    if( !dst ){
+      // Not a staging atlas (or it is full), go through a copy.
+      raster.pixels.resize(glyph.size.width * glyph.size.height);
+      freetype::copy_bitmap(d->ftFace, raster.pixels.data(), glyph.size.width);
+      return insert_glyph(raster);
+    }
+    freetype::copy_bitmap(d->ftFace, dst, pitch);
+    d->touch(glyph.page);
+
+    Glyph &slot=d->alloc_glyph();
+    slot=glyph;
+    d->table.insert(glyph.code, &slot);
+    if( d->useCache ){
+      raster.pixels.resize(glyph.size.width * glyph.size.height);
+      for(size_t y=0; y < glyph.size.height; ++y)
+        memcpy(&raster.pixels[y*glyph.size.width], dst + y*pitch,
+               glyph.size.width);
+      d->uncached.push_back( std::move(raster) );
+    }
+    return slot;
   }
   //}}}-----------------------------------------------------------------------//
   //{{{ void load(const String &face, size_t size)
@@ -216,26 +921,80 @@ namespace ngl{
     m_name=face;
     m_size=size;
 
-    const FT_Library &handle = freetype::handle();
-    if( FT_New_Face(handle, face.c_str(), 0, &d->ftFace) ){
-      fprintf(stderr, "Failed to load font face.\n");
+    if( !freetype::open_face(freetype::handle(), face, size, d->ftFace) )
       return;
-    }
 
-    if( FT_Set_Char_Size(d->ftFace,
-                         static_cast<uint32_t>(m_size)<<6,
-                         static_cast<uint32_t>(m_size)<<6,
-                         96, 96) ){
-      fprintf(stderr, "Failed to set font size.\n");
-      return;
-    }
+    m_maxSize=freetype::max_size(d->ftFace);
 
-    // TODO: try changing to float.
-    float k     = (float)d->ftFace->size->metrics.x_ppem
-                  / d->ftFace->units_per_EM;
-    m_maxSize.x = (d->ftFace->bbox.xMax - d->ftFace->bbox.xMin) * k;
-    m_maxSize.y = (d->ftFace->bbox.yMax - d->ftFace->bbox.yMin) * k;
-    m_maxSize.y*= 0.9f;
+    load_cache();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool Pimpl::rasterize(Codepoint code, RasterGlyph &out)
+  /// Renders a glyph with the face's own FT_Face, as a distance field for
+  /// SDF faces.
+  //--------------------------------------------------------------------------//
+  bool FontFace::Pimpl::rasterize(Codepoint code, RasterGlyph &out){
+    if( !freetype::rasterize(ftFace, code, out) )
+      return false;
+    if( sdfSpread )
+      sdf::generate(out, sdfSpread);
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Glyph& Pimpl::alloc_glyph()
+  /// \returns
+  ///   A Glyph::null slot, reusing the slots of evicted glyphs first.
+  //--------------------------------------------------------------------------//
+  Glyph& FontFace::Pimpl::alloc_glyph(){
+    if( freeGlyphs.empty() ){
+      glyphs.push_back(Glyph::null);
+      return glyphs.back();
+    }
+    Glyph *glyph=freeGlyphs.back();
+    freeGlyphs.pop_back();
+    *glyph=Glyph::null;
+    return *glyph;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const Glyph& Pimpl::mark_missing(Codepoint code)
+  /// Makes get_glyph return Glyph::null for a glyph the atlas had no room
+  /// for, until a page is evicted (or the next frame, with a budget).
+  //--------------------------------------------------------------------------//
+  const Glyph& FontFace::Pimpl::mark_missing(Codepoint code){
+    table.insert(code, &missing);
+    missingCodes.push_back(code);
+    return missing;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void Pimpl::retry_missing()
+  /// Lets get_glyph try again to load the glyphs the atlas had no room for.
+  //--------------------------------------------------------------------------//
+  void FontFace::Pimpl::retry_missing(){
+    for(size_t i=0; i < missingCodes.size(); ++i){
+      if( table.find(missingCodes[i]) == &missing )
+        table.insert(missingCodes[i], NULL);
+    }
+    missingCodes.clear();
+  }
+  //}}}-----------------------------------------------------------------------//
+  void FontFace::Pimpl::touch(uint32_t page){ //{{{
+    if( page >= pageUsed.size() )
+      pageUsed.resize(page+1, 0);
+    pageUsed[page]=frame;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void Pimpl::begin_frame(const IGlyphAtlas &atlas)
+  /// Starts a new frame on the first print after update(). Counting frames
+  /// here rather than in update() keeps one frame per real frame however
+  /// many Fonts share the face, and the pages of a frame safe from the
+  /// glyphs update() adds at its end.
+  //--------------------------------------------------------------------------//
+  void FontFace::Pimpl::begin_frame(const IGlyphAtlas &atlas){
+    if( frameEnded ){
+      ++frame;
+      frameEnded    =false;
+      frameUploaded =atlas.uploaded();
+    }
   }
   //}}}
 
@@ -274,6 +1033,129 @@ namespace ngl{
 
       return g_library;
     }
+    //}}}---------------------------------------------------------------------//
+    //------------------------------------------------------------------------//
+    static void close_stream(FT_Stream stream){ //{{{
+      fontfiles::release( static_cast<const byte*>(stream->descriptor.pointer) );
+      delete stream;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ bool open_face(FT_Library lib, const String &face, size_t size, ...)
+    /// Opens \a face with \a lib and sets its size.
+    ///
+    /// The file is read from its shared mapping (see fontfiles). The face
+    /// gets a memory stream over it that releases the mapping when FreeType
+    /// closes it. Falls back to letting FreeType read the file if it cannot
+    /// be mapped.
+    ///   \param[out] out   The face, NULL on failure.
+    //------------------------------------------------------------------------//
+    bool open_face(FT_Library lib, const String &face, size_t size,
+                   FT_Face &out){
+      out=nullptr;
+      size_t      fileSize;
+      const byte  *file=fontfiles::acquire(face, fileSize);
+      FT_Error    err;
+      if( file ){
+        FT_Stream stream=new FT_StreamRec;
+        memset(stream, 0, sizeof(FT_StreamRec));
+        stream->base              =const_cast<byte*>(file);
+        stream->size              =fileSize;
+        stream->descriptor.pointer=const_cast<byte*>(file);
+        stream->close             =close_stream;
+
+        FT_Open_Args args;
+        memset(&args, 0, sizeof(args));
+        args.flags  =FT_OPEN_STREAM;
+        args.stream =stream;
+        // Closes the stream on failure as well.
+        err=FT_Open_Face(lib, &args, 0, &out);
+      }
+      else
+        err=FT_New_Face(lib, face.c_str(), 0, &out);
+
+      if( err ){
+        fprintf(stderr, "Failed to load font face.\n");
+        out=nullptr;
+        return false;
+      }
+
+      if( FT_Set_Char_Size(out,
+                           static_cast<uint32_t>(size)<<6,
+                           static_cast<uint32_t>(size)<<6,
+                           kDPI, kDPI) ){
+        fprintf(stderr, "Failed to set font size.\n");
+        FT_Done_Face(out);
+        out=nullptr;
+        return false;
+      }
+      return true;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ bool load_glyph(FT_Face face, Codepoint code, RasterGlyph &out)
+    /// Renders a single glyph into the face's glyph slot and fills the
+    /// metrics of \a out, the bitmap is left in the slot (see copy_bitmap).
+    //------------------------------------------------------------------------//
+    bool load_glyph(FT_Face face, Codepoint code, RasterGlyph &out){
+      out.code    =code;
+      out.loaded  =false;
+      out.pixels.clear();
+      // Tabs are rendered as spaces.
+      if( FT_Load_Char(face, (code == '\t' ? ' ' : code), kLoadFlags) ){
+        fprintf(stderr, "FT_Load_Char failed for U+%04X.\n", code);
+        out.size.set(0, 0);
+        return false;
+      }
+
+      const FT_Bitmap &bitmap=face->glyph->bitmap;
+      out.size.set(bitmap.width, bitmap.rows);
+      out.advance = (face->glyph->advance.x >> 6);
+      out.off.x   = ( face->glyph->metrics.horiBearingX >> 6 )
+                    - ( face->glyph->metrics.width >> 6 );
+      out.off.y   = ( face->glyph->metrics.horiBearingY >> 6 )
+                    - ( face->glyph->metrics.height >> 6 );
+      out.loaded  = true;
+      return true;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ void copy_bitmap(FT_Face face, byte *dst, size_t pitch)
+    /// Copies the bitmap of the last load_glyph() to \a dst, flipped
+    /// bottom-up, rows \a pitch bytes apart.
+    //------------------------------------------------------------------------//
+    void copy_bitmap(FT_Face face, byte *dst, size_t pitch){
+      const FT_Bitmap &bitmap=face->glyph->bitmap;
+      for(int y = 0; y < bitmap.rows; ++y){
+        memcpy( dst + y * pitch,
+                bitmap.buffer + (bitmap.rows - y - 1)* bitmap.pitch,
+                bitmap.width);
+      }
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ bool rasterize(FT_Face face, Codepoint code, RasterGlyph &out)
+    /// Renders a single glyph. Safe to call from any thread, as long as no
+    /// other thread uses \a face at the same time.
+    //------------------------------------------------------------------------//
+    bool rasterize(FT_Face face, Codepoint code, RasterGlyph &out){
+      if( !load_glyph(face, code, out) )
+        return false;
+
+      out.pixels.resize(out.size.width * out.size.height);
+      copy_bitmap(face, out.pixels.data(), out.size.width);
+      return true;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ uint2 max_size(FT_Face face)
+    /// \returns
+    ///   Size of the face bounding box (in pixels), see FontFace::maxSize().
+    //------------------------------------------------------------------------//
+    uint2 max_size(FT_Face face){
+      // TODO: try changing to float.
+      float k   = (float)face->size->metrics.x_ppem / face->units_per_EM;
+      uint2 ret;
+      ret.x = (face->bbox.xMax - face->bbox.xMin) * k;
+      ret.y = (face->bbox.yMax - face->bbox.yMin) * k;
+      ret.y*= 0.9f;
+      return ret;
+    }
     //}}}
   }
 
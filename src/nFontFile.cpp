@@ -0,0 +1,136 @@
+//==============================================================================
+/**
+\file            FontFile.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nFontFile.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ngl{
+  namespace fontfiles{
+    struct Mapping{
+      String    path;
+      size_t    size;
+      size_t    refs;
+    };
+    typedef std::map<String, const byte*>     Paths;
+    typedef std::map<const byte*, Mapping>    Mappings;
+
+    static Paths        g_paths;
+    static Mappings     g_mappings;
+    static size_t       g_mappedBytes=0;
+    static std::mutex   g_lock;
+
+    //------------------------------------------------------------------------//
+    //{{{ const byte* acquire(const String &path, size_t &size)
+    /// Maps the font file at \a path, or returns the existing mapping of the
+    /// same file. Every successful call has to be matched by a release().
+    ///   \param[in]  path  Font file. Different paths to one file (relative,
+    ///                     symlinks) share the mapping.
+    ///   \param[out] size  File size.
+    /// \returns
+    ///   Start of the file contents or NULL if it could not be mapped.
+    //------------------------------------------------------------------------//
+    const byte* acquire(const String &path, size_t &size){
+      char    resolved[PATH_MAX];
+      String  key=( realpath(path.c_str(), resolved) ? resolved : path );
+
+      std::lock_guard<std::mutex> guard(g_lock);
+      Paths::iterator it=g_paths.find(key);
+      if( it != g_paths.end() ){
+        Mapping &mapping=g_mappings[it->second];
+        ++mapping.refs;
+        size=mapping.size;
+        return it->second;
+      }
+
+      const byte *data;
+      if( !map_file(key, data, size) )
+        return NULL;
+
+      Mapping mapping;
+      mapping.path  =key;
+      mapping.size  =size;
+      mapping.refs  =1;
+      g_paths[key]    =data;
+      g_mappings[data]=mapping;
+      g_mappedBytes+=size;
+      return data;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ void release(const byte *data)
+    /// Drops a reference taken by acquire(), unmapping the file with the
+    /// last one.
+    //------------------------------------------------------------------------//
+    void release(const byte *data){
+      std::lock_guard<std::mutex> guard(g_lock);
+      Mappings::iterator it=g_mappings.find(data);
+      if( it == g_mappings.end() ){
+        fprintf(stderr, "Releasing font file %p that is not mapped.\n",
+                (const void*)data);
+        return;
+      }
+      if( --it->second.refs )
+        return;
+
+      unmap_file(data, it->second.size);
+      g_mappedBytes-=it->second.size;
+      g_paths.erase(it->second.path);
+      g_mappings.erase(it);
+    }
+    //}}}---------------------------------------------------------------------//
+    size_t count(){ //{{{
+      std::lock_guard<std::mutex> guard(g_lock);
+      return g_mappings.size();
+    }
+    //}}}---------------------------------------------------------------------//
+    size_t mapped_bytes(){ //{{{
+      std::lock_guard<std::mutex> guard(g_lock);
+      return g_mappedBytes;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ bool map_file(const String &path, const byte *&data, size_t &size)
+    /// Maps the whole file at \a path read only, without any bookkeeping.
+    //------------------------------------------------------------------------//
+    bool map_file(const String &path, const byte *&data, size_t &size){
+      int fd=::open(path.c_str(), O_RDONLY);
+      if( fd < 0 )
+        return false;
+
+      struct stat info;
+      if( fstat(fd, &info) || info.st_size == 0 ){
+        ::close(fd);
+        return false;
+      }
+
+      void *mem=mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if( mem == MAP_FAILED )
+        return false;
+
+      data=static_cast<const byte*>(mem);
+      size=info.st_size;
+      return true;
+    }
+    //}}}---------------------------------------------------------------------//
+    void unmap_file(const byte *data, size_t size){ //{{{
+      munmap(const_cast<byte*>(data), size);
+    }
+    //}}}
+  }
+}
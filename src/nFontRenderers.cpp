@@ -18,6 +18,8 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 #include <GL/glu.h>
 #include <GL/glx.h>
 
+#include <algorithm>
+
 
 #if defined(N_WIN32_BUILD) || defined(N_WIN32_CONSOLE_BUILD)
 #  define STDCALL __stdcall
@@ -53,6 +55,11 @@ Copyright (c) 2010 Mateusz 'novo' Klos
 // glPrimitiveRestart
 #define GL_PRIMITIVE_RESTART_NV   0x8558
 
+// Texture swizzle (ARB_texture_swizzle)
+#if !defined(GL_TEXTURE_SWIZZLE_RGBA)
+#  define GL_TEXTURE_SWIZZLE_RGBA 0x8E46
+#endif
+
 
 //typedef void      (STDCALL * PFNGLGENBUFFERSARBPROC)        (GLsizei n, GLuint *buffers);
 //typedef void      (STDCALL * PFNGLDELETEBUFFERSARBPROC)     (GLsizei n, const GLuint *buffers);
@@ -67,8 +74,13 @@ PFNGLISBUFFERARBPROC        glIsBuffer              =0;
 PFNGLDELETEBUFFERSARBPROC   glDeleteBuffers         =0;
 PFNGLBINDBUFFERARBPROC      glBindBuffer            =0;
 PFNGLBUFFERDATAARBPROC      glBufferData            =0;
+PFNGLBUFFERSUBDATAARBPROC   glBufferSubData         =0;
 PFNGLMAPBUFFERARBPROC       glMapBuffer             =0;
 PFNGLUNMAPBUFFERARBPROC     glUnmapBuffer           =0;
+// Fences (ARB_sync), for GLGlyphAtlas' upload buffers.
+PFNGLFENCESYNCPROC          glFenceSync             =0;
+PFNGLCLIENTWAITSYNCPROC     glClientWaitSync        =0;
+PFNGLDELETESYNCPROC         glDeleteSync            =0;
 
 namespace ngl{
   //--------------------------------------------------------------------------//
@@ -80,8 +92,12 @@ namespace ngl{
   AbstractRenderer::~AbstractRenderer(){
   }
   //--------------------------------------------------------------------------//
+  /// Distance field fonts (Font::is_sdf) are alpha tested at the outline
+  /// (0.5), their atlas is sampled with linear filtering. Vertex color alpha
+  /// scales the field, so translucent SDF text gets thinner rather than
+  /// fading out.
   //--------------------------------------------------------------------------//
-  int AbstractRenderer::state_setup(){
+  int AbstractRenderer::state_setup(const Font &font){
     float view[4];
     Error err;
     uint32_t attr =GL_TEXTURE_BIT
@@ -99,6 +115,10 @@ namespace ngl{
     GL_DBG( glLoadIdentity()                                          );
     GL_DBG( glEnable(GL_BLEND)                                        );
     GL_DBG( glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)         );
+    if( font.is_sdf() ){
+      GL_DBG( glEnable(GL_ALPHA_TEST)                                 );
+      GL_DBG( glAlphaFunc(GL_GEQUAL, 0.5f)                            );
+    }
     return EOk;
   }
   //--------------------------------------------------------------------------//
@@ -112,6 +132,64 @@ namespace ngl{
     return EOk;
   }
   //--------------------------------------------------------------------------//
+  /// Binds the texture of \a batch. Textures shared by several fonts
+  /// (ChannelGlyphAtlas) are swizzled so the batch's channel is read as
+  /// alpha, and white as color, which is what an alpha texture gives.
+  //--------------------------------------------------------------------------//
+  int AbstractRenderer::bind_batch(const Font::Batch &batch){
+    GL_DBG( glBindTexture(GL_TEXTURE_2D, batch.texID)                 );
+    if( batch.channel >= 0 ){
+      const GLint swizzle[4]={ GL_ONE, GL_ONE, GL_ONE,
+                               GL_RED+batch.channel };
+      GL_DBG( glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA,
+                               swizzle)                               );
+    }
+    return EOk;
+  }
+  //--------------------------------------------------------------------------//
+  /// Points the vertex, texture coordinate and color arrays at \a first,
+  /// a client memory pointer or an offset into the bound buffer object.
+  //--------------------------------------------------------------------------//
+  int AbstractRenderer::vertex_pointers(const Font::Vertex *first){
+    GL_DBG( glVertexPointer(2, GL_INT,
+                            sizeof(Font::Vertex),
+                            (byte*)first+OFFSET(Font::Vertex, position) ) );
+    GL_DBG( glTexCoordPointer(2, GL_FLOAT,
+                            sizeof(Font::Vertex),
+                            (byte*)first+OFFSET(Font::Vertex, texCoord) ) );
+    GL_DBG( glColorPointer(4, GL_UNSIGNED_BYTE,
+                            sizeof(Font::Vertex),
+                            (byte*)first+OFFSET(Font::Vertex, color) )    );
+    return EOk;
+  }
+  //--------------------------------------------------------------------------//
+  /// Draws \a triCount triangles of Font::quad_indices() from \a firstTri
+  /// on, in chunks of at most Font::kMaxQuads quads. The vertex pointers
+  /// are moved to \a vb + \a base only when a chunk is out of the reach
+  /// of the 16 bit indices from there, so consecutive draws share them.
+  ///   \param[in]  vb        Client memory, or NULL for the bound buffer.
+  ///   \param[in]  indices   Font::quad_indices(), or NULL for the bound
+  ///                         index buffer holding them.
+  ///   \param[in,out] base   Vertex the pointers are at, ~0 if unset.
+  //--------------------------------------------------------------------------//
+  int AbstractRenderer::draw_quads(const Font::Vertex *vb, size_t firstTri,
+                                   size_t triCount, const void *indices,
+                                   size_t &base){
+    const size_t kMaxTris=Font::kMaxQuads*2;
+    for(size_t t=firstTri; t < firstTri+triCount; t+=kMaxTris){
+      const size_t count=std::min(firstTri+triCount - t, kMaxTris);
+      if( base == ~(size_t)0 || t*2 < base
+          || (t+count)*2 > base + Font::kMaxQuads*4 ){
+        base=t*2;
+        GL_DBG( vertex_pointers(vb + base)                            );
+      }
+      GL_DBG( glDrawElements(GL_TRIANGLES, count*3, GL_UNSIGNED_SHORT,
+                             (const byte*)indices
+                             + (t - base/2)*sizeof(Triangle16))       );
+    }
+    return EOk;
+  }
+  //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   void AbstractRenderer::print_info(const Font &font){
     bool        printInfo       =false;
@@ -137,45 +215,52 @@ namespace ngl{
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   LegacyRenderer::LegacyRenderer()
-  :m_vertCount(0), m_vb(0), m_ib(0){
+  :m_vertCount(0), m_vb(0){
     printf("Using legacy renderer\n");
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   LegacyRenderer::~LegacyRenderer(){
     delete[] m_vb;
-    delete[] m_ib;
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   int LegacyRenderer::render(const Font &font){
-    TextureID     texID;
     if( font.vertex_count() > m_vertCount )
       extend_buffers( font.vertex_count() );
-    font.get_geometry(m_vb, m_ib, texID);
-
-    const Font::Vertex *v;
-
-    state_setup();
-    glBindTexture (GL_TEXTURE_2D, texID);
-    glBegin       (GL_TRIANGLES);
-    for(size_t i=0;  i < font.tri_count(); ++i){
-      v =&m_vb[ m_ib[i].a ];
-      glColor4ubv ( (byte*)&v->color );
-      glTexCoord2f( v->texCoord.u, v->texCoord.v );
-      glVertex2i  ( v->position.x, v->position.y );
-
-      v =&m_vb[ m_ib[i].b ];
-      glColor4ubv ( (byte*)&v->color );
-      glTexCoord2f( v->texCoord.u, v->texCoord.v );
-      glVertex2i  ( v->position.x, v->position.y );
-
-      v =&m_vb[ m_ib[i].c ];
-      glColor4ubv ( (byte*)&v->color );
-      glTexCoord2f( v->texCoord.u, v->texCoord.v );
-      glVertex2i  ( v->position.x, v->position.y );
+    font.get_geometry(m_vb, m_batches);
+
+    // The two triangles of the first quad, every quad is the same.
+    const Triangle16    *quad=Font::quad_indices();
+    const Font::Vertex  *v;
+
+    state_setup(font);
+    for(size_t b=0; b < m_batches.size(); ++b){
+      const Font::Batch &batch=m_batches[b];
+      const Font::Vertex *first=&m_vb[ batch.firstTri*2 ];
+      bind_batch    (batch);
+      glBegin       (GL_TRIANGLES);
+      for(size_t i=0; i < batch.triCount; ++i){
+        const Font::Vertex  *corners=&first[ (i >> 1)*4 ];
+        const Triangle16    &tri    =quad[ i & 1 ];
+
+        v =&corners[ tri.a ];
+        glColor4ubv ( (byte*)&v->color );
+        glTexCoord2f( v->texCoord.u, v->texCoord.v );
+        glVertex2i  ( v->position.x, v->position.y );
+
+        v =&corners[ tri.b ];
+        glColor4ubv ( (byte*)&v->color );
+        glTexCoord2f( v->texCoord.u, v->texCoord.v );
+        glVertex2i  ( v->position.x, v->position.y );
+
+        v =&corners[ tri.c ];
+        glColor4ubv ( (byte*)&v->color );
+        glTexCoord2f( v->texCoord.u, v->texCoord.v );
+        glVertex2i  ( v->position.x, v->position.y );
+      }
+      glEnd();
     }
-    glEnd();
     glFlush();
 
     state_cleanup();
@@ -187,12 +272,10 @@ namespace ngl{
   int LegacyRenderer::extend_buffers(uint32_t vertCount){
     if( m_vb )
       delete[] m_vb;
-    if( m_ib )
-      delete[] m_ib;
 
     m_vertCount=vertCount;
     m_vb =new Font::Vertex [m_vertCount];
-    m_ib =new Triangle16   [m_vertCount/2];
+    return EOk;
   }
 
 
@@ -201,47 +284,48 @@ namespace ngl{
   
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
-  VARenderer::VARenderer(){
+  VARenderer::VARenderer()
+  :m_vertCount(0), m_vb(0){
     printf("Using VA renderer\n");
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   VARenderer::~VARenderer(){
+    delete[] m_vb;
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   int VARenderer::render(const Font &font){
-    TextureID     texID;
-    Font::Vertex  *vb =new Font::Vertex [font.vertex_count()];
-    Triangle16    *ib =new Triangle16   [font.tri_count()];
-    font.get_geometry(vb, ib, texID);
+    if( font.vertex_count() > m_vertCount )
+      extend_buffers( font.vertex_count() );
+    font.get_geometry(m_vb, m_batches);
 
-    state_setup();
-    GL_DBG( glBindTexture(GL_TEXTURE_2D, texID)                       );
+    state_setup(font);
     GL_DBG( glEnableClientState(GL_VERTEX_ARRAY)                      );
     GL_DBG( glEnableClientState(GL_COLOR_ARRAY)                       );
     GL_DBG( glEnableClientState(GL_TEXTURE_COORD_ARRAY)               );
 
-    GL_DBG( glVertexPointer(2, GL_INT,
-                            sizeof(Font::Vertex),
-                            (byte*)vb+OFFSET(Font::Vertex, position) ) );
-    GL_DBG( glTexCoordPointer(2, GL_FLOAT,
-                            sizeof(Font::Vertex),
-                            (byte*)vb+OFFSET(Font::Vertex, texCoord) ) );
-    GL_DBG( glColorPointer(4, GL_UNSIGNED_BYTE,
-                            sizeof(Font::Vertex),
-                            (byte*)vb+OFFSET(Font::Vertex, color) ) );
-
-    GL_DBG(
-      glDrawElements(GL_TRIANGLES, font.tri_count()*3, GL_UNSIGNED_SHORT, ib)
-    );
+    size_t base=~(size_t)0;
+    for(size_t b=0; b < m_batches.size(); ++b){
+      const Font::Batch &batch=m_batches[b];
+      GL_DBG( bind_batch(batch)                                       );
+      GL_DBG( draw_quads(m_vb, batch.firstTri, batch.triCount,
+                         Font::quad_indices(), base)                  );
+    }
     glFlush();
 
 
     state_cleanup();
-
-    delete[] vb;
-    delete[] ib;
+    return EOk;
+  }
+  //--------------------------------------------------------------------------//
+  /// Grows the vertex array by half again what is asked, so a slowly
+  /// growing text does not reallocate every frame.
+  //--------------------------------------------------------------------------//
+  int VARenderer::extend_buffers(uint32_t vertCount){
+    delete[] m_vb;
+    m_vertCount=vertCount + vertCount/2;
+    m_vb =new Font::Vertex [m_vertCount];
     return EOk;
   }
 
@@ -252,74 +336,114 @@ namespace ngl{
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   VBORenderer::VBORenderer()
-  :m_vb(0), m_ib(0), m_vertCount(0){
-    Error err;
-    glGenBuffers(1, &m_vb);
+  :m_ib(0), m_uploaded(0){
+    // No GL_DBG, it returns; a failure is reported by gl_error_check().
     glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 Font::kMaxQuads*2*sizeof(Triangle16),
+                 Font::quad_indices(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl_error_check("VBORenderer(): quad index buffer");
     printf("Using VBO renderer\n");
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   VBORenderer::~VBORenderer(){
-    glDeleteBuffers(1, &m_vb);
+    for(Buffers::iterator it=m_buffers.begin(); it != m_buffers.end(); ++it)
+      glDeleteBuffers(1, &it->second.vb);
     glDeleteBuffers(1, &m_ib);
   }
   //--------------------------------------------------------------------------//
+  /// Deletes the buffer of \a font, call it before the font goes.
+  //--------------------------------------------------------------------------//
+  void VBORenderer::forget(const Font &font){
+    Buffers::iterator it=m_buffers.find(&font);
+    if( it == m_buffers.end() )
+      return;
+    glDeleteBuffers(1, &it->second.vb);
+    m_buffers.erase(it);
+  }
+  //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   int VBORenderer::render(const Font &font){
-    TextureID     texID;
-    if( font.vertex_count() > m_vertCount )
-      extend_buffers( font.vertex_count() );
-    
-    Font::Vertex  *vb=(Font::Vertex*) glMapBuffer(GL_ARRAY_BUFFER,
-                                                  GL_WRITE_ONLY);
-    Triangle16    *ib=(Triangle16*)   glMapBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                                                  GL_WRITE_ONLY);
-    font.get_geometry(vb, ib, texID);
-
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    const Font::Resident &resident=font.resident();
+    Buffers::iterator it=m_buffers.find(&font);
+    if( it == m_buffers.end() ){
+      Buffer buffer={ 0, 0, 0 };
+      glGenBuffers(1, &buffer.vb);
+      it=m_buffers.insert( Buffers::value_type(&font, buffer) ).first;
+    }
+    upload(it->second, resident);
 
-    state_setup();
-    GL_DBG( glBindTexture(GL_TEXTURE_2D, texID)                       );
+    state_setup(font);
     GL_DBG( glEnableClientState(GL_VERTEX_ARRAY)                      );
     GL_DBG( glEnableClientState(GL_COLOR_ARRAY)                       );
     GL_DBG( glEnableClientState(GL_TEXTURE_COORD_ARRAY)               );
-
-    GL_DBG( glVertexPointer(2, GL_INT,
-                            sizeof(Font::Vertex),
-                            OFFSET(Font::Vertex, position) ) );
-    GL_DBG( glTexCoordPointer(2, GL_FLOAT,
-                            sizeof(Font::Vertex),
-                            (void*)OFFSET(Font::Vertex, texCoord) ) );
-    GL_DBG( glColorPointer(4, GL_UNSIGNED_BYTE,
-                            sizeof(Font::Vertex),
-                            (void*)OFFSET(Font::Vertex, color) ) );
-
-    GL_DBG(
-      glDrawElements(GL_TRIANGLES, font.tri_count()*3, GL_UNSIGNED_SHORT, 0)
-    );
+    GL_DBG( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib)               );
+
+    // Every Draw is moved to where its text was printed; the texture and
+    // the translation are only changed between draws that differ, the
+    // vertex pointers when a draw is out of their reach (draw_quads).
+    const Font::Batch *bound  =NULL;
+    int2              offset (0, 0);
+    size_t            base   =~(size_t)0;
+    for(size_t d=0; d < resident.draws.size(); ++d){
+      const Font::Draw  &draw =resident.draws[d];
+      const Font::Batch &batch=draw.batch;
+      if( !bound || bound->texID != batch.texID
+          || bound->channel != batch.channel ){
+        GL_DBG( bind_batch(batch)                                     );
+        bound=&batch;
+      }
+      if( draw.offset.x != offset.x || draw.offset.y != offset.y ){
+        GL_DBG( glTranslatef((float)(draw.offset.x - offset.x),
+                             (float)(draw.offset.y - offset.y), 0.0f) );
+        offset=draw.offset;
+      }
+      GL_DBG( draw_quads(NULL, batch.firstTri, batch.triCount, NULL,
+                         base)                                        );
+    }
+    GL_DBG( glLoadIdentity()                                          );
     glFlush();
     state_cleanup();
 
+    GL_DBG( glBindBuffer(GL_ARRAY_BUFFER, 0)                          );
+    GL_DBG( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0)                  );
     return EOk;
   }
   //--------------------------------------------------------------------------//
-  //--------------------------------------------------------------------------//
-  int VBORenderer::extend_buffers(uint32_t vertCount){
-    m_vertCount =vertCount;
-    Error   err;
-    GL_DBG( glBindBuffer(GL_ARRAY_BUFFER, m_vb)               );
-    GL_DBG( glBufferData(GL_ARRAY_BUFFER,
-                         m_vertCount*sizeof(Font::Vertex),
-                         0,
-                         GL_STREAM_DRAW)   );
-    
-    GL_DBG( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib)       );
-    GL_DBG( glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                         m_vertCount/2*sizeof(Triangle16),
-                         0,
-                         GL_STREAM_DRAW)   );
+  /// Brings \a buffer up to date with \a resident and leaves it bound.
+  /// Only the ranges written since the last update are sent, if the buffer
+  /// holds the previous one; everything otherwise (first frame, the
+  /// buffer grew, the font was not drawn for an update).
+  //--------------------------------------------------------------------------//
+  int VBORenderer::upload(Buffer &buffer, const Font::Resident &resident){
+    m_uploaded=0;
+    GL_DBG( glBindBuffer(GL_ARRAY_BUFFER, buffer.vb)                  );
+    if( resident.capacity != buffer.vertCount
+        || ( buffer.serial != resident.prevSerial
+             && buffer.serial != resident.serial ) ){
+      buffer.vertCount=resident.capacity;
+      GL_DBG( glBufferData(GL_ARRAY_BUFFER,
+                           buffer.vertCount*sizeof(Font::Vertex),
+                           resident.vb,
+                           GL_DYNAMIC_DRAW)                           );
+      m_uploaded+=buffer.vertCount*sizeof(Font::Vertex);
+    }
+    else if( buffer.serial == resident.prevSerial ){
+      for(size_t i=0; i < resident.uploads.size(); ++i){
+        const Chunk &range=resident.uploads[i];
+        GL_DBG( glBufferSubData(GL_ARRAY_BUFFER,
+                                range.off*sizeof(Font::Vertex),
+                                range.size*sizeof(Font::Vertex),
+                                resident.vb+range.off)                );
+        m_uploaded+=range.size*sizeof(Font::Vertex);
+      }
+    }
+    buffer.serial=resident.serial;
+    return EOk;
   }
 
 
@@ -360,8 +484,12 @@ namespace ngl{
     glIsBuffer      =load_proc<PFNGLISBUFFERARBPROC>     ("glIsBufferARB");
     glBindBuffer    =load_proc<PFNGLBINDBUFFERARBPROC>   ("glBindBufferARB");
     glBufferData    =load_proc<PFNGLBUFFERDATAARBPROC>   ("glBufferDataARB");
+    glBufferSubData =load_proc<PFNGLBUFFERSUBDATAARBPROC>("glBufferSubDataARB");
     glDeleteBuffers =load_proc<PFNGLDELETEBUFFERSARBPROC>("glDeleteBuffersARB");
     glMapBuffer     =load_proc<PFNGLMAPBUFFERARBPROC>    ("glMapBufferARB");
     glUnmapBuffer   =load_proc<PFNGLUNMAPBUFFERARBPROC>  ("glUnmapBufferARB");
+    glFenceSync     =load_proc<PFNGLFENCESYNCPROC>       ("glFenceSync");
+    glClientWaitSync=load_proc<PFNGLCLIENTWAITSYNCPROC>  ("glClientWaitSync");
+    glDeleteSync    =load_proc<PFNGLDELETESYNCPROC>      ("glDeleteSync");
   }
 }
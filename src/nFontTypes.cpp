@@ -42,6 +42,45 @@ namespace ngl{
 
     return hash;
   }
+  //--------------------------------------------------------------------------//
+  /// 64 bit hash (MurmurHash64A), 8 bytes at a time. Much faster than
+  /// gen_hash for strings, and 64 bits make collisions between the strings
+  /// Font caches unlikely. The words are read in the machine's byte order,
+  /// so the result is not to be stored in files.
+  ///   \param[in]  seed    Hash of preceding data, to chain calls.
+  //--------------------------------------------------------------------------//
+  Hash64_t gen_hash64(const void *data, size_t size, Hash64_t seed){
+    const uint64_t  kMul  =0xc6a4a7935bd1e995ull;
+    const int       kShift=47;
+
+    const byte  *bytes=static_cast<const byte*>(data);
+    const byte  *end  =bytes + (size & ~(size_t)7);
+    uint64_t    hash  =seed ^ (size * kMul);
+    for(; bytes != end; bytes+=8){
+      uint64_t word;
+      memcpy(&word, bytes, 8);
+      word *=kMul;
+      word ^=word >> kShift;
+      word *=kMul;
+      hash ^=word;
+      hash *=kMul;
+    }
+
+    switch( size & 7 ){
+      case 7: hash^=uint64_t(bytes[6]) << 48;
+      case 6: hash^=uint64_t(bytes[5]) << 40;
+      case 5: hash^=uint64_t(bytes[4]) << 32;
+      case 4: hash^=uint64_t(bytes[3]) << 24;
+      case 3: hash^=uint64_t(bytes[2]) << 16;
+      case 2: hash^=uint64_t(bytes[1]) << 8;
+      case 1: hash^=uint64_t(bytes[0]);
+              hash*=kMul;
+    }
+    hash^=hash >> kShift;
+    hash*=kMul;
+    hash^=hash >> kShift;
+    return hash;
+  }
   const Color32  Color32::black     (0xff000000);
   const Color32  Color32::white     (0xffffffff);
   const Color32  Color32::grey      (0xff808080);
@@ -78,7 +117,18 @@ namespace ngl{
     Size2( 0, 0 ),
     int2( 0, 0 ),
     0.0f,
-    NULL
+    NULL,
+    0
+  };
+  const Glyph Glyph::pending={
+    kReplacementChar,
+    TexCoords( 0.0f, 0.0f ),
+    TexCoords( 0.0f, 0.0f ),
+    Size2( 0, 0 ),
+    int2( 0, 0 ),
+    0.0f,
+    NULL,
+    0
   };
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
@@ -99,12 +149,6 @@ namespace ngl{
 
 
 
-  struct MemHeader{
-    uint32_t    magic;
-    size_t      prevFree;
-    size_t      nextFree;
-    
-  };
   //--------------------------------------------------------------------------//
   /// \brief  Copy constructor.
   ///   \param[in]  obj   MemPool object to copy from.
@@ -127,76 +171,129 @@ namespace ngl{
   MemPool::MemPool()
   :m_data(NULL),
   m_size(0),
-  m_available(0){
+  m_available(0),
+  m_free(ChunkMap::key_compare(), &m_freeNodes),
+  m_freeBySize(FreeIndex::key_compare(), &m_freeBySizeNodes),
+  m_used(ChunkMap::key_compare(), &m_usedNodes){
   }
   //--------------------------------------------------------------------------//
   /// \brief  Destructor.
   //--------------------------------------------------------------------------//
   MemPool::~MemPool(){
+    clear();
   }
   //--------------------------------------------------------------------------//
+  /// Allocates the memory, releasing what was there before.
+  ///   \param[in]  size    In bytes.
   //--------------------------------------------------------------------------//
   void MemPool::init(size_t size){
-    m_data=new byte[m_size=m_available=size];
-    m_free.push_back( Chunk(0, m_size) );
+    clear();
+    m_data=new byte[m_size=size];
+    if( m_size )
+      add_free(0, m_size);
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
   void MemPool::clear(){
-    if(m_data){
-      delete[] m_data;
-      m_data      =NULL;
-      m_size      =0;
-      m_available =0;
-      m_free.clear();
-    }
+    delete[] m_data;
+    m_data      =NULL;
+    m_size      =0;
+    m_available =0;
+    m_free.clear();
+    m_freeBySize.clear();
+    m_used.clear();
   }
   //--------------------------------------------------------------------------//
+  /// Moves all allocations to the front of the pool, in address order.
+  ///   \param[out] transfers   The moves made, (from, to) pairs in the
+  ///                           order made.
   //--------------------------------------------------------------------------//
   void MemPool::defragment(std::list<MemAddr2> &transfers){
     transfers.clear();
+    if( !m_data )
+      return;
+
+    ChunkMap  used(m_used.key_comp(), m_used.get_allocator());
+    size_t    top=0;
+    for(ChunkMap::const_iterator it=m_used.begin(); it!=m_used.end(); ++it){
+      if( it->first != top ){
+        // Moving down, overlapping ranges are fine for memmove.
+        memmove(m_data+top, m_data+it->first, it->second);
+        transfers.push_back( MemAddr2(m_data+it->first, m_data+top) );
+      }
+      used.insert(used.end(), std::make_pair(top, it->second));
+      top+=it->second;
+    }
+    m_used.swap(used);
+
+    m_free.clear();
+    m_freeBySize.clear();
+    m_available=0;
+    if( top < m_size )
+      add_free(top, m_size-top);
   }
   //--------------------------------------------------------------------------//
+  /// \returns
+  ///   \a size bytes, aligned to kAlignment, or NULL if no free chunk is big
+  ///   enough.
   //--------------------------------------------------------------------------//
   MemAddr_t MemPool::alloc(size_t size){
     if( !m_data ){
       fprintf(stderr, "alloc(): Memory pool not initialized.\n");
       return NULL;
     }
-    
-    FreeList::iterator mem=m_free.begin();
-    for( ; (mem != m_free.end()) && (mem->size < size); ++mem){
-    }
+    size=( size ? (size + kAlignment-1) & ~(kAlignment-1) : kAlignment );
 
-    if( mem == m_free.end() ){
+    FreeIndex::iterator best=m_freeBySize.lower_bound( Chunk(0, size) );
+    if( best == m_freeBySize.end() ){
       fprintf(stderr, "alloc(): No free space left.\n");
       return NULL;
     }
-    
-    // found free.
-    MemAddr_t ret=m_data+mem->off;
-    if( mem->size > size ){
-      mem->size -= size;
-      mem->off  += size;
-    }
-    else{
-      m_free.erase(mem);
-    }
-    return ret;
+
+    const Chunk chunk=*best;
+    remove_free( m_free.find(chunk.off) );
+    if( chunk.size > size )
+      add_free(chunk.off + size, chunk.size - size);
+    m_used.insert( std::make_pair(chunk.off, size) );
+    return m_data+chunk.off;
   }
   //--------------------------------------------------------------------------//
+  /// Gives back memory from alloc(), merging it with the free chunks it
+  /// touches.
   //--------------------------------------------------------------------------//
   void MemPool::free(MemAddr_t addr){
     if( !m_data ){
-      fprintf(stderr, "alloc(): Memory pool not initialized.\n");
+      fprintf(stderr, "free(): Memory pool not initialized.\n");
       return;
     }
 
-    FreeList::iterator prev=prev_free(addr);
-    if( m_data+prev->off == addr ){
-      // The previous free touches the current block - merge.
-      
+    ChunkMap::iterator used=m_used.end();
+    if( addr >= m_data && addr < m_data+m_size )
+      used=m_used.find( (byte*)addr - m_data );
+    if( used == m_used.end() ){
+      fprintf(stderr, "free(): %p was not allocated from the pool.\n", addr);
+      return;
+    }
+
+    size_t off =used->first;
+    size_t size=used->second;
+    m_used.erase(used);
+
+    ChunkMap::iterator next=m_free.lower_bound(off);
+    if( next != m_free.begin() ){
+      ChunkMap::iterator prev=next;
+      --prev;
+      if( prev->first + prev->second == off ){
+        off  =prev->first;
+        size+=prev->second;
+        remove_free(prev);
+      }
     }
+    if( next != m_free.end() && off + size == next->first ){
+      size+=next->second;
+      remove_free(next);
+    }
+    add_free(off, size);
   }
   //--------------------------------------------------------------------------//
   //--------------------------------------------------------------------------//
@@ -209,19 +306,32 @@ namespace ngl{
     return m_size;
   }
   //--------------------------------------------------------------------------//
+  /// \returns
+  ///   Free bytes, possibly spread over many chunks.
   //--------------------------------------------------------------------------//
   size_t MemPool::available() const{
-    return 0;
+    return m_available;
   }
   //--------------------------------------------------------------------------//
+  /// \returns
+  ///   Size of the biggest free chunk, the most alloc() can return now.
   //--------------------------------------------------------------------------//
-  MemPool::FreeList::iterator MemPool::prev_free(MemAddr_t addr){
-    for(FreeList::iterator it=++m_free.begin(); it!=m_free.end(); ++it){
-      if( addr < &m_data[it->off] )
-        return --it;
-    }
-    return m_free.end();
+  size_t MemPool::largest() const{
+    return ( m_freeBySize.empty() ? 0 : m_freeBySize.rbegin()->size );
+  }
+  //--------------------------------------------------------------------------//
+  //--------------------------------------------------------------------------//
+  void MemPool::add_free(size_t off, size_t size){
+    m_free.insert( std::make_pair(off, size) );
+    m_freeBySize.insert( Chunk(off, size) );
+    m_available+=size;
+  }
+  //--------------------------------------------------------------------------//
+  //--------------------------------------------------------------------------//
+  void MemPool::remove_free(ChunkMap::iterator chunk){
+    m_freeBySize.erase( Chunk(chunk->first, chunk->second) );
+    m_available-=chunk->second;
+    m_free.erase(chunk);
   }
 
-  
 }
@@ -1,20 +1,71 @@
 #include <nGLGlyphAtlas.hpp>
+#include <nChannelGlyphAtlas.hpp>
 
 #include <GL/gl.h>
 #include <GL/glu.h>
 
+#include <cstring>
+
+#if !defined(GL_PIXEL_UNPACK_BUFFER)
+#  define GL_PIXEL_UNPACK_BUFFER        0x88EC
+#  define GL_STREAM_DRAW                0x88E0
+#  define GL_WRITE_ONLY                 0x88B9
+#endif
+#if !defined(GL_SYNC_GPU_COMMANDS_COMPLETE)
+#  define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#  define GL_ALREADY_SIGNALED           0x911A
+#  define GL_CONDITION_SATISFIED        0x911C
+#endif
+
+// Loaded by init_extensions(), see nFontRenderers.cpp. Left 0 if the
+// driver does not have them.
+extern PFNGLGENBUFFERSARBPROC     glGenBuffers;
+extern PFNGLDELETEBUFFERSARBPROC  glDeleteBuffers;
+extern PFNGLBINDBUFFERARBPROC     glBindBuffer;
+extern PFNGLBUFFERDATAARBPROC     glBufferData;
+extern PFNGLMAPBUFFERARBPROC      glMapBuffer;
+extern PFNGLUNMAPBUFFERARBPROC    glUnmapBuffer;
+extern PFNGLFENCESYNCPROC         glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC    glClientWaitSync;
+extern PFNGLDELETESYNCPROC        glDeleteSync;
+
 namespace ngl{
+  //============================================================================
+  //{{{ GLGlyphAtlas::UploadRing
+  /// Pixel buffers the uploads are streamed through, used in turn.
+  //============================================================================
+  struct GLGlyphAtlas::UploadRing{
+    UploadRing(size_t capacity);
+    ~UploadRing();
+
+    byte* map(size_t bytes);
+    bool  unmap();
+    void  fence();
+
+    GLuint    buffers[kUploadBuffers];
+    GLsync    fences[kUploadBuffers];
+    size_t    capacity;   // bytes of every buffer, a whole page.
+    size_t    current;    // buffer mapped by the last map().
+  };//}}}
+
+
+
   //--------------------------------------------------------------------------//
-  // {{{ GLGlyphAtlas::GLGlyphAtlas(size_t width, size_t height)
+  // {{{ GLGlyphAtlas::GLGlyphAtlas(size_t width, size_t height, bool linear)
   /// \brief  Default constructor.
+  ///   \param[in]  width, height   Size of every page.
+  ///   \param[in]  linear          Use linear texture filtering (distance
+  ///                               field glyphs) instead of nearest.
   //--------------------------------------------------------------------------//
-  GLGlyphAtlas::GLGlyphAtlas(size_t width, size_t height)
-  :   m_texture       ( 0 ),
-      m_size          ( Size2::null ),
-      m_freeOff       ( Size2::null ),
-      m_currRowHeight ( 0 )
+  GLGlyphAtlas::GLGlyphAtlas(size_t width, size_t height, bool linear)
+  :   MemoryGlyphAtlas( width, height ),
+      m_ring          ( new UploadRing(width*height) ),
+      m_uploaded      ( 0 ),
+      m_linear        ( linear )
   {
-    init_atlas(width, height);
+    // The first page was added before page_added() was ours.
+    for(size_t i=0; i < pages(); ++i)
+      page_added(i);
   }
   //}}}-----------------------------------------------------------------------//
   //{{{ GLGlyphAtlas(const GLGlyphAtlas &obj)
@@ -22,15 +73,15 @@ namespace ngl{
   ///   \param[in]  obj   GLGlyphAtlas to copy from.
   ///
   //--------------------------------------------------------------------------//
-  GLGlyphAtlas::GLGlyphAtlas(const GLGlyphAtlas &obj){
+  GLGlyphAtlas::GLGlyphAtlas(const GLGlyphAtlas &obj)
+  :MemoryGlyphAtlas(0, 0), m_ring(NULL){
   }
   //}}}-----------------------------------------------------------------------//
   //{{{ ~GLGlyphAtlas()
   GLGlyphAtlas::~GLGlyphAtlas(){
-    if(m_texture){
-      glDeleteTextures(1, &m_texture);
-      m_texture=0;
-    }
+    delete m_ring;
+    if( !m_textures.empty() )
+      glDeleteTextures(m_textures.size(), &m_textures[0]);
   }
   //}}}-----------------------------------------------------------------------//
   //{{{ GLGlyphAtlas& operator=(const GLGlyphAtlas &obj)
@@ -43,82 +94,211 @@ namespace ngl{
     return *this;
   }
   //}}}-----------------------------------------------------------------------//
-  //{{{ Error add(Glyph &out, const byte *rgbData, const Size2 &size)
-  Error GLGlyphAtlas::add(Glyph &out, const byte *rgbData, const Size2 &size){
-    // If the glyph is too wide, go to next row.
-    if( m_freeOff.x + size.width > m_size.width ){
-      m_freeOff.y +=m_currRowHeight;
-      m_freeOff.x  =0;
+  //{{{ Error flush()
+  /// Uploads the dirty parts of the CPU copies.
+  //--------------------------------------------------------------------------//
+  Error GLGlyphAtlas::flush(){
+    Error ret=EOk;
+    for(size_t i=0; i < m_pages.size(); ++i){
+      Error err=upload(i);
+      if( err && !ret )
+        ret=err;
     }
+    return ret;
+  }
+  //}}}-----------------------------------------------------------------------//
+  TextureID GLGlyphAtlas::texid(size_t page) const{ //{{{
+    return ( page < m_textures.size() ? m_textures[page] : 0 );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Error upload(size_t index)
+  /// Uploads the dirty part of a page's CPU copy, through the next buffer
+  /// of the ring if there are buffer objects.
+  //--------------------------------------------------------------------------//
+  Error GLGlyphAtlas::upload(size_t index){
+    Page          &page =*m_pages[index];
+    const Region  &dirty=page.dirty;
+    if( dirty.max.x <= dirty.min.x || dirty.max.y <= dirty.min.y )
+      return EOk;
 
-    if( m_freeOff.y+size.height > m_size.height ||
-        m_freeOff.x+size.width  > m_size.width   )
-      return ENotEnoughMemory;
+    const Size2 size(dirty.max.x-dirty.min.x, dirty.max.y-dirty.min.y);
+    const byte  *src=&page.pixels[ dirty.min.y*m_size.width + dirty.min.x ];
+    GLint       rowLength=(GLint)m_size.width;
 
-    Error err;
-    GL_DBG( glPushAttrib(GL_TEXTURE_BIT)                             );
-    GL_DBG( glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT)            );
-    GL_DBG( glBindTexture(GL_TEXTURE_2D, m_texture)                  );
-    GL_DBG( glPixelStorei(GL_UNPACK_ALIGNMENT,    1)                 );
-    GL_DBG( glPixelStorei(GL_UNPACK_SWAP_BYTES,   GL_FALSE)          );
-    GL_DBG( glPixelStorei(GL_UNPACK_SKIP_ROWS,    GL_FALSE)          );
-    GL_DBG( glPixelStorei(GL_UNPACK_SKIP_PIXELS,  GL_FALSE)          );
-    GL_DBG( glPixelStorei(GL_UNPACK_ROW_LENGTH,   (GLint)size.width) );
+    // The rows are copied next to each other into the buffer, the texture
+    // update then reads from it at offset 0.
+    byte *dst=m_ring->map(size.width*size.height);
+    if( dst ){
+      for(size_t y=0; y < size.height; ++y)
+        memcpy(dst + y*size.width, src + y*m_size.width, size.width);
+      if( m_ring->unmap() ){
+        src       =NULL;
+        rowLength =0;
+      }
+    }
 
+    GL_DBG( glPushAttrib(GL_TEXTURE_BIT)                               );
+    GL_DBG( glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT)              );
+    GL_DBG( glBindTexture(GL_TEXTURE_2D, m_textures[index])            );
+    GL_DBG( glPixelStorei(GL_UNPACK_ALIGNMENT,    1)                   );
+    GL_DBG( glPixelStorei(GL_UNPACK_SWAP_BYTES,   GL_FALSE)            );
+    GL_DBG( glPixelStorei(GL_UNPACK_SKIP_ROWS,    GL_FALSE)            );
+    GL_DBG( glPixelStorei(GL_UNPACK_SKIP_PIXELS,  GL_FALSE)            );
+    GL_DBG( glPixelStorei(GL_UNPACK_ROW_LENGTH,   rowLength)           );
     GL_DBG( glTexSubImage2D(GL_TEXTURE_2D,
                             0,
-                            static_cast<GLint>(m_freeOff.x),
-                            static_cast<GLint>(m_freeOff.y),
+                            static_cast<GLint>(dirty.min.x),
+                            static_cast<GLint>(dirty.min.y),
                             static_cast<GLsizei>(size.width),
                             static_cast<GLsizei>(size.height),
                             GL_ALPHA,
                             GL_UNSIGNED_BYTE,
-                            rgbData)
+                            src)
           );
-
     GL_DBG( glPopClientAttrib()   );
     GL_DBG( glPopAttrib()         );
-    out.owner       = this;
-    out.botLeft.u   = (float)m_freeOff.x / (float)m_size.width;
-    out.botLeft.v   = (float)m_freeOff.y / (float)m_size.height;
-    out.topRight.u  = (m_freeOff.x+size.width)  / (float)m_size.width;
-    out.topRight.v  = (m_freeOff.y+size.height) / (float)m_size.height;
-
-    m_freeOff.x+=size.width;
-    if(size.height > m_currRowHeight)
-      m_currRowHeight=size.height;
+    if( dst )
+      m_ring->fence();
 
+    m_uploaded+=size.width*size.height;
+    page.dirty.min=page.dirty.max=uint2(0, 0);
     return EOk;
   }
   //}}}-----------------------------------------------------------------------//
-  //{{{ Error init_atlas(size_t width, size_t height)
-  Error GLGlyphAtlas::init_atlas(size_t width, size_t height){
-    Error err;
-    GL_DBG( glPushAttrib    ( GL_TEXTURE_BIT) );
-    GL_DBG( glGenTextures   ( 1, &m_texture) );
-    GL_DBG( glBindTexture   ( GL_TEXTURE_2D, m_texture) );
-
-    GL_DBG( glTexParameteri ( GL_TEXTURE_2D,
-                              GL_TEXTURE_MIN_FILTER,
-                              GL_NEAREST) );
-
-    GL_DBG( glTexParameteri ( GL_TEXTURE_2D,
-                              GL_TEXTURE_MAG_FILTER,
-                              GL_NEAREST) );
-
-    GL_DBG( glTexImage2D    ( GL_TEXTURE_2D,
-                              0,
-                              GL_ALPHA,
-                              width,
-                              height,
-                              0,
-                              GL_ALPHA,
-                              GL_UNSIGNED_BYTE,
-                              0) );
-    GL_DBG( glPopAttrib     () );
-
-    m_size.set(width, height);
-    return EOk;
+  //{{{ void page_added(size_t page)
+  /// Creates the texture of a new page.
+  //--------------------------------------------------------------------------//
+  void GLGlyphAtlas::page_added(size_t page){
+    m_textures.resize(page+1, 0);
+
+    GLint filter=( m_linear ? GL_LINEAR : GL_NEAREST );
+    glPushAttrib    ( GL_TEXTURE_BIT);
+    glGenTextures   ( 1, &m_textures[page]);
+    glBindTexture   ( GL_TEXTURE_2D, m_textures[page]);
+
+    glTexParameteri ( GL_TEXTURE_2D,
+                      GL_TEXTURE_MIN_FILTER,
+                      filter);
+
+    glTexParameteri ( GL_TEXTURE_2D,
+                      GL_TEXTURE_MAG_FILTER,
+                      filter);
+
+    glTexImage2D    ( GL_TEXTURE_2D,
+                      0,
+                      GL_ALPHA,
+                      m_size.width,
+                      m_size.height,
+                      0,
+                      GL_ALPHA,
+                      GL_UNSIGNED_BYTE,
+                      0);
+    glPopAttrib     ();
+    gl_error_check("GLGlyphAtlas::page_added");
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void page_removed(size_t page)
+  /// Deletes the texture of the last page.
+  //--------------------------------------------------------------------------//
+  void GLGlyphAtlas::page_removed(size_t page){
+    glDeleteTextures(1, &m_textures[page]);
+    m_textures.resize(page);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ UploadRing::UploadRing(size_t capacity)
+  //--------------------------------------------------------------------------//
+  GLGlyphAtlas::UploadRing::UploadRing(size_t capacity)
+  :   capacity  ( capacity ),
+      current   ( kUploadBuffers-1 )
+  {
+    for(size_t i=0; i < kUploadBuffers; ++i){
+      buffers[i]=0;
+      fences[i] =0;
+    }
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ UploadRing::~UploadRing()
+  GLGlyphAtlas::UploadRing::~UploadRing(){
+    for(size_t i=0; i < kUploadBuffers; ++i){
+      if( fences[i] )
+        glDeleteSync(fences[i]);
+    }
+    if( buffers[0] )
+      glDeleteBuffers(kUploadBuffers, buffers);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ byte* UploadRing::map(size_t bytes)
+  /// Binds the next buffer of the ring and maps it. The buffer is reused
+  /// if its fence says the GPU is done with it, otherwise its storage is
+  /// orphaned: the driver hands out new memory instead of making the CPU
+  /// wait for the previous upload.
+  /// \returns
+  ///   Room for \a bytes, or NULL if there are no buffer objects (nothing
+  ///   is bound then).
+  //--------------------------------------------------------------------------//
+  byte* GLGlyphAtlas::UploadRing::map(size_t bytes){
+    if( !glBindBuffer || !glMapBuffer || bytes > capacity )
+      return NULL;
+    if( !buffers[0] )
+      glGenBuffers(kUploadBuffers, buffers);
+
+    current=(current+1) % kUploadBuffers;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[current]);
+
+    bool idle=false;
+    if( fences[current] ){
+      GLenum state=glClientWaitSync(fences[current], 0, 0);
+      idle=( state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED );
+      glDeleteSync(fences[current]);
+      fences[current]=0;
+    }
+    if( !idle )
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+
+    byte *dst=static_cast<byte*>( glMapBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                              GL_WRITE_ONLY) );
+    if( !dst )
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return dst;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool UploadRing::unmap()
+  /// \returns
+  ///   false if the buffer contents were lost, the buffer is unbound then
+  ///   and the upload has to come from client memory.
+  //--------------------------------------------------------------------------//
+  bool GLGlyphAtlas::UploadRing::unmap(){
+    if( glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) )
+      return true;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return false;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void UploadRing::fence()
+  /// Marks the end of the upload from the current buffer and unbinds it.
+  //--------------------------------------------------------------------------//
+  void GLGlyphAtlas::UploadRing::fence(){
+    if( glFenceSync )
+      fences[current]=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ IGlyphAtlas *create_atlas(AtlasType type, size_t width, ...)
+  /// Creates an atlas of the given type.
+  ///   \param[in]  width, height   Page size.
+  ///   \param[in]  linear          Linear filtering (GL atlases only).
+  //--------------------------------------------------------------------------//
+  IGlyphAtlas *create_atlas(AtlasType type, size_t width, size_t height,
+                            bool linear){
+    switch(type){
+      case Atlas::GL:           return new GLGlyphAtlas(width, height, linear);
+      case Atlas::Memory:       return new MemoryGlyphAtlas(width, height);
+      case Atlas::Channel:
+        if( ChannelGlyphAtlas::supported() )
+          return new ChannelGlyphAtlas(width, height, linear);
+        return new GLGlyphAtlas(width, height, linear);
+      default:                  return 0;
+    }
   }
   //}}}
 }
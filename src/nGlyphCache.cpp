@@ -0,0 +1,395 @@
+//==============================================================================
+/**
+\file            GlyphCache.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nGlyphCache.hpp"
+#include "nFontFile.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+namespace ngl{
+  //--------------------------------------------------------------------------//
+  //--------------------------------------------------------------------------//
+  bool GlyphCacheKey::operator==(const GlyphCacheKey &obj) const{
+    return fontHash   == obj.fontHash   &&
+           fontSize   == obj.fontSize   &&
+           pointSize  == obj.pointSize  &&
+           dpi        == obj.dpi        &&
+           loadFlags  == obj.loadFlags  &&
+           sdfSpread  == obj.sdfSpread;
+  }
+
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ static bool replace_file(const String &path, const byte *data, ...)
+  /// Writes \a data to a temporary file first and then renames it over
+  /// \a path, so readers (including processes that have the old file
+  /// mapped) never see a half written file.
+  //--------------------------------------------------------------------------//
+  static bool replace_file(const String &path, const byte *data, size_t size){
+    const String tmpPath=path+".tmp";
+    FILE *file=fopen(tmpPath.c_str(), "wb");
+    if( !file ){
+      fprintf(stderr, "Failed to write %s.\n", path.c_str());
+      return false;
+    }
+
+    bool ok=(fwrite(data, 1, size, file) == size);
+    ok=(fclose(file) == 0) && ok;
+    if( !ok || rename(tmpPath.c_str(), path.c_str()) ){
+      fprintf(stderr, "Failed to write %s.\n", path.c_str());
+      remove(tmpPath.c_str());
+      return false;
+    }
+    return true;
+  }
+  //}}}
+
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ GlyphCache()
+  /// \brief  Default constructor.
+  //--------------------------------------------------------------------------//
+  GlyphCache::GlyphCache()
+  :m_data(NULL),
+  m_size(0),
+  m_mapped(false){
+  }
+  //}}}-----------------------------------------------------------------------//
+  GlyphCache::~GlyphCache(){ //{{{
+    close();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool open(const String &path, const GlyphCacheKey &key)
+  /// Maps the cache file at \a path.
+  /// \returns
+  ///   false if the file does not exist, is damaged, has a different version
+  ///   or was made for a different key. The cache stays closed in that case.
+  //--------------------------------------------------------------------------//
+  bool GlyphCache::open(const String &path, const GlyphCacheKey &key){
+    close();
+    if( !fontfiles::map_file(path, m_data, m_size) )
+      return false;
+
+    m_mapped=true;
+    if( !validate(path) )
+      return false;
+    if( this->key() != key ){
+      close();
+      return false;
+    }
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool attach(const byte *data, size_t size)
+  /// Uses the cache image at \a data, which has to stay valid until the
+  /// cache is closed. No key check is done.
+  //--------------------------------------------------------------------------//
+  bool GlyphCache::attach(const byte *data, size_t size){
+    close();
+    m_data  =data;
+    m_size  =size;
+    return validate("glyph cache image");
+  }
+  //}}}-----------------------------------------------------------------------//
+  void GlyphCache::close(){ //{{{
+    if( m_data && m_mapped )
+      fontfiles::unmap_file(m_data, m_size);
+    m_data  =NULL;
+    m_size  =0;
+    m_mapped=false;
+  }
+  //}}}-----------------------------------------------------------------------//
+  size_t GlyphCache::size() const{ //{{{
+    if( !m_data )
+      return 0;
+    return reinterpret_cast<const Header*>(m_data)->glyphCount;
+  }
+  //}}}-----------------------------------------------------------------------//
+  const GlyphCache::Record& GlyphCache::record(size_t index) const{ //{{{
+    return reinterpret_cast<const Record*>(m_data+sizeof(Header))[index];
+  }
+  //}}}-----------------------------------------------------------------------//
+  const byte* GlyphCache::bitmap(const Record &rec) const{ //{{{
+    return m_data+rec.dataOffset;
+  }
+  //}}}-----------------------------------------------------------------------//
+  const GlyphCacheKey& GlyphCache::key() const{ //{{{
+    return reinterpret_cast<const Header*>(m_data)->key;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool validate(const String &name)
+  /// Checks the header and that all records lie within the image. Closes
+  /// the cache on failure.
+  ///   \param[in]  name    Used in error messages.
+  //--------------------------------------------------------------------------//
+  bool GlyphCache::validate(const String &name){
+    const Header *header=reinterpret_cast<const Header*>(m_data);
+    if( m_size < sizeof(Header) ||
+        header->magic != kMagic || header->version != kVersion ){
+      fprintf(stderr, "%s: unsupported glyph cache version.\n", name.c_str());
+      close();
+      return false;
+    }
+    if( sizeof(Header) + header->glyphCount*sizeof(Record) > m_size ){
+      fprintf(stderr, "%s: glyph cache truncated.\n", name.c_str());
+      close();
+      return false;
+    }
+    for(size_t i=0; i < size(); ++i){
+      const Record &rec=record(i);
+      if( rec.dataOffset + uint64_t(rec.width)*rec.height > m_size ){
+        fprintf(stderr, "%s: glyph cache truncated.\n", name.c_str());
+        close();
+        return false;
+      }
+    }
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void serialize(key, records, bitmaps, out)
+  /// Builds a cache image in memory.
+  ///   \param[in]  records   Glyph records, dataOffset is filled in here.
+  ///   \param[in]  bitmaps   Bitmap of each record.
+  //--------------------------------------------------------------------------//
+  void GlyphCache::serialize(const GlyphCacheKey             &key,
+                             const std::vector<Record>       &records,
+                             const std::vector<const byte*>  &bitmaps,
+                             std::vector<byte>               &out){
+    std::vector<Record> recs(records);
+    uint64_t size=sizeof(Header) + recs.size()*sizeof(Record);
+    for(size_t i=0; i < recs.size(); ++i){
+      recs[i].dataOffset =size;
+      size              +=(uint64_t(recs[i].width)*recs[i].height + 7) & ~7ull;
+    }
+
+    out.assign(size, 0);
+    Header *header    =reinterpret_cast<Header*>(&out[0]);
+    header->magic     =kMagic;
+    header->version   =kVersion;
+    header->key       =key;
+    header->glyphCount=recs.size();
+    if( !recs.empty() )
+      memcpy(&out[sizeof(Header)], &recs[0], recs.size()*sizeof(Record));
+    for(size_t i=0; i < recs.size(); ++i){
+      memcpy(&out[recs[i].dataOffset], bitmaps[i],
+             size_t(recs[i].width)*recs[i].height);
+    }
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool write(path, key, records, bitmaps)
+  /// Writes a cache file, see serialize().
+  //--------------------------------------------------------------------------//
+  bool GlyphCache::write(const String                   &path,
+                         const GlyphCacheKey            &key,
+                         const std::vector<Record>      &records,
+                         const std::vector<const byte*> &bitmaps){
+    std::vector<byte> image;
+    serialize(key, records, bitmaps, image);
+    return replace_file(path, &image[0], image.size());
+  }
+  //}}}
+
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ BakedFont()
+  /// \brief  Default constructor.
+  //--------------------------------------------------------------------------//
+  BakedFont::BakedFont()
+  :m_data(NULL),
+  m_size(0){
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ BakedFont(const String &path)
+  /// Opens the baked font at \a path, see is_open().
+  //--------------------------------------------------------------------------//
+  BakedFont::BakedFont(const String &path)
+  :m_data(NULL),
+  m_size(0){
+    open(path);
+  }
+  //}}}-----------------------------------------------------------------------//
+  BakedFont::~BakedFont(){ //{{{
+    close();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool open(const String &path)
+  /// Maps a file written by nfonts_bake.
+  //--------------------------------------------------------------------------//
+  bool BakedFont::open(const String &path){
+    close();
+    if( !fontfiles::map_file(path, m_data, m_size) ){
+      fprintf(stderr, "Failed to open baked font %s.\n", path.c_str());
+      return false;
+    }
+
+    const Header *header=reinterpret_cast<const Header*>(m_data);
+    if( m_size < sizeof(Header) ||
+        header->magic != kMagic || header->version != kVersion ){
+      fprintf(stderr, "%s: unsupported baked font version.\n", path.c_str());
+      close();
+      return false;
+    }
+    const Face *face=reinterpret_cast<const Face*>(m_data+sizeof(Header));
+    if( sizeof(Header) + header->faceCount*sizeof(Face) > m_size ){
+      fprintf(stderr, "%s: baked font truncated.\n", path.c_str());
+      close();
+      return false;
+    }
+    for(size_t i=0; i < header->faceCount; ++i){
+      if( face[i].offset + face[i].size > m_size ){
+        fprintf(stderr, "%s: baked font truncated.\n", path.c_str());
+        close();
+        return false;
+      }
+    }
+    m_name=path;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  void BakedFont::close(){ //{{{
+    if( m_data ){
+      fontfiles::unmap_file(m_data, m_size);
+      m_data=NULL;
+      m_size=0;
+    }
+    m_name.clear();
+  }
+  //}}}-----------------------------------------------------------------------//
+  size_t BakedFont::faces() const{ //{{{
+    if( !m_data )
+      return 0;
+    return reinterpret_cast<const Header*>(m_data)->faceCount;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const Face* find(size_t pointSize) const
+  /// \returns
+  ///   The face baked at \a pointSize, NULL if there is none.
+  //--------------------------------------------------------------------------//
+  const BakedFont::Face* BakedFont::find(size_t pointSize) const{
+    const Face *face=reinterpret_cast<const Face*>(m_data+sizeof(Header));
+    for(size_t i=0; i < faces(); ++i){
+      if( face[i].pointSize == pointSize )
+        return &face[i];
+    }
+    return NULL;
+  }
+  //}}}-----------------------------------------------------------------------//
+  const byte* BakedFont::image(const Face &face) const{ //{{{
+    return m_data+face.offset;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool write(path, faces, images)
+  /// Writes a baked font.
+  ///   \param[in]  faces   Faces, offset and size are filled in here.
+  ///   \param[in]  images  GlyphCache image of each face.
+  //--------------------------------------------------------------------------//
+  bool BakedFont::write(const String                           &path,
+                        const std::vector<Face>                &faces,
+                        const std::vector< std::vector<byte> > &images){
+    std::vector<Face> table(faces);
+    uint64_t size=sizeof(Header) + table.size()*sizeof(Face);
+    for(size_t i=0; i < table.size(); ++i){
+      table[i].offset =size;
+      table[i].size   =images[i].size();
+      size           +=(images[i].size() + 7) & ~7ull;
+    }
+
+    std::vector<byte> out(size, 0);
+    Header *header    =reinterpret_cast<Header*>(&out[0]);
+    header->magic     =kMagic;
+    header->version   =kVersion;
+    header->faceCount =table.size();
+    if( !table.empty() )
+      memcpy(&out[sizeof(Header)], &table[0], table.size()*sizeof(Face));
+    for(size_t i=0; i < table.size(); ++i){
+      if( !images[i].empty() )
+        memcpy(&out[table[i].offset], &images[i][0], images[i].size());
+    }
+    return replace_file(path, &out[0], out.size());
+  }
+  //}}}
+
+
+
+
+  namespace glyphcache{
+    static String   g_directory;
+    //------------------------------------------------------------------------//
+    //{{{ void set_directory(const String &dir)
+    /// Sets the directory glyph cache files are kept in. An empty string (the
+    /// default) disables the cache.
+    //------------------------------------------------------------------------//
+    void set_directory(const String &dir){
+      g_directory=dir;
+    }
+    //}}}---------------------------------------------------------------------//
+    const String& directory(){ //{{{
+      return g_directory;
+    }
+    //}}}---------------------------------------------------------------------//
+    bool enabled(){ //{{{
+      return !g_directory.empty();
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ String file_name(const String &face, const GlyphCacheKey &key)
+    /// Every field of \a key goes into the name, so faces differing only
+    /// in e.g. the distance field spread (an SDF face is loaded at
+    /// sdf::kReferenceSize) do not overwrite each other's file.
+    /// \returns
+    ///   Path of the cache file for \a face with \a key.
+    //------------------------------------------------------------------------//
+    String file_name(const String &face, const GlyphCacheKey &key){
+      String::size_type slash=face.find_last_of('/');
+      String base=( slash == String::npos ? face : face.substr(slash+1) );
+
+      const uint64_t rest[]={ key.fontSize, key.dpi, key.loadFlags,
+                              key.sdfSpread };
+      const Hash_t   restHash=gen_hash(reinterpret_cast<const byte*>(rest),
+                                       sizeof(rest));
+      char suffix[96];
+      snprintf(suffix, sizeof(suffix), "-%upt-sdf%u-%016llx-%08x.nglc",
+               key.pointSize, key.sdfSpread,
+               (unsigned long long)key.fontHash, restHash);
+      return g_directory + '/' + base + suffix;
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ bool hash_file(const String &path, GlyphCacheKey &key)
+    /// Fills GlyphCacheKey::fontHash and GlyphCacheKey::fontSize for the
+    /// font file at \a path.
+    //------------------------------------------------------------------------//
+    bool hash_file(const String &path, GlyphCacheKey &key){
+      size_t      size;
+      const byte  *data=fontfiles::acquire(path, size);
+      if( !data )
+        return false;
+
+      // Hashed in chunks, the way the file used to be read, so existing
+      // cache files keep their names.
+      const size_t kChunkSize=64*1024;
+      Hash_t hash=0;
+      for(size_t off=0; off < size; off+=kChunkSize)
+        hash=gen_hash(data+off, std::min(kChunkSize, size-off), hash);
+      fontfiles::release(data);
+
+      key.fontHash=hash;
+      key.fontSize=size;
+      return true;
+    }
+    //}}}
+  }
+}
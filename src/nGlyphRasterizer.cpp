@@ -0,0 +1,184 @@
+//==============================================================================
+/**
+\file            GlyphRasterizer.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nGlyphRasterizer.hpp"
+#include "nGlyphSDF.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ngl{
+  namespace freetype{
+    bool open_face(FT_Library lib, const String &face, size_t size,
+                   FT_Face &out);
+    bool rasterize(FT_Face face, Codepoint code, RasterGlyph &out);
+  }
+
+  struct GlyphRasterizer::Pimpl{
+    struct Worker{
+      FT_Library    library;
+      FT_Face       face;
+      std::thread   thread;
+    };
+    typedef std::deque<Codepoint>   Requests;
+
+    void run(Worker *worker);
+
+    std::vector<Worker*>      workers;
+    Requests                  requests;
+    RasterGlyphs              done;
+    size_t                    pending;
+    size_t                    sdfSpread;
+    bool                      quit;
+    mutable std::mutex        lock;
+    std::condition_variable   wakeUp;
+    std::condition_variable   finished;
+  };
+
+
+
+  //--------------------------------------------------------------------------//
+  //{{{ GlyphRasterizer(const String &face, size_t sizeInPt, ...)
+  /// \brief  Starts the workers.
+  ///   \param[in]  face        Font file, opened once per worker.
+  ///   \param[in]  sizeInPt    Size in pt.
+  ///   \param[in]  numThreads  Number of worker threads.
+  ///   \param[in]  sdfSpread   See sdf::generate, 0 for plain bitmaps.
+  //--------------------------------------------------------------------------//
+  GlyphRasterizer::GlyphRasterizer(const String &face,
+                                   size_t sizeInPt,
+                                   size_t numThreads,
+                                   size_t sdfSpread)
+  :d(new Pimpl){
+    d->pending  =0;
+    d->sdfSpread=sdfSpread;
+    d->quit     =false;
+
+    for(size_t i=0; i < numThreads; ++i){
+      Pimpl::Worker *worker=new Pimpl::Worker;
+      worker->face=nullptr;
+      if( FT_Init_FreeType(&worker->library) ){
+        fprintf(stderr, "Failed to initialize freetype library.\n");
+        delete worker;
+        continue;
+      }
+      if( !freetype::open_face(worker->library, face, sizeInPt,
+                               worker->face) ){
+        FT_Done_FreeType(worker->library);
+        delete worker;
+        continue;
+      }
+      d->workers.push_back(worker);
+    }
+    for(size_t i=0; i < d->workers.size(); ++i){
+      d->workers[i]->thread=std::thread(&Pimpl::run, d, d->workers[i]);
+    }
+  }
+  //}}}-----------------------------------------------------------------------//
+  GlyphRasterizer::~GlyphRasterizer(){ //{{{
+    {
+      std::lock_guard<std::mutex> guard(d->lock);
+      d->quit=true;
+    }
+    d->wakeUp.notify_all();
+
+    for(size_t i=0; i < d->workers.size(); ++i){
+      Pimpl::Worker *worker=d->workers[i];
+      worker->thread.join();
+      FT_Done_Face(worker->face);
+      FT_Done_FreeType(worker->library);
+      delete worker;
+    }
+    delete d;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void request(Codepoint code)
+  /// Queues \a code for rasterization. The caller is responsible for not
+  /// requesting the same glyph twice.
+  //--------------------------------------------------------------------------//
+  void GlyphRasterizer::request(Codepoint code){
+    {
+      std::lock_guard<std::mutex> guard(d->lock);
+      d->requests.push_back(code);
+      ++d->pending;
+    }
+    d->wakeUp.notify_one();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void wait()
+  /// Blocks until all requested glyphs are rasterized.
+  //--------------------------------------------------------------------------//
+  void GlyphRasterizer::wait(){
+    std::unique_lock<std::mutex> guard(d->lock);
+    while( d->done.size() < d->pending && !d->workers.empty() )
+      d->finished.wait(guard);
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t collect(RasterGlyphs &out)
+  /// Moves all finished glyphs to \a out.
+  /// \returns
+  ///   Number of glyphs appended to \a out.
+  //--------------------------------------------------------------------------//
+  size_t GlyphRasterizer::collect(RasterGlyphs &out){
+    std::lock_guard<std::mutex> guard(d->lock);
+    size_t count=d->done.size();
+    for(size_t i=0; i < count; ++i)
+      out.push_back( std::move(d->done[i]) );
+    d->done.clear();
+    d->pending-=count;
+    return count;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t pending() const
+  /// \returns
+  ///   Number of requested glyphs that were not collected yet.
+  //--------------------------------------------------------------------------//
+  size_t GlyphRasterizer::pending() const{
+    std::lock_guard<std::mutex> guard(d->lock);
+    return d->pending;
+  }
+  //}}}-----------------------------------------------------------------------//
+  size_t GlyphRasterizer::threads() const{ //{{{
+    return d->workers.size();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void Pimpl::run(Worker *worker)
+  /// Worker thread main loop.
+  //--------------------------------------------------------------------------//
+  void GlyphRasterizer::Pimpl::run(Worker *worker){
+    RasterGlyph glyph;
+    std::unique_lock<std::mutex> guard(lock);
+    for(;;){
+      while( !quit && requests.empty() )
+        wakeUp.wait(guard);
+      if( quit )
+        return;
+
+      Codepoint code=requests.front();
+      requests.pop_front();
+
+      guard.unlock();
+      if( freetype::rasterize(worker->face, code, glyph) && sdfSpread )
+        sdf::generate(glyph, sdfSpread);
+      guard.lock();
+
+      done.push_back( std::move(glyph) );
+      finished.notify_all();
+    }
+  }
+  //}}}
+}
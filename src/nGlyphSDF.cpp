@@ -0,0 +1,129 @@
+//==============================================================================
+/**
+\file            GlyphSDF.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nGlyphSDF.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace ngl{
+  namespace sdf{
+    static const float kInf=1e20f;
+    //------------------------------------------------------------------------//
+    //{{{ static void edt_1d(const float *f, float *d, size_t n, ...)
+    /// Squared euclidean distance transform of a sampled function (lower
+    /// envelope of parabolas, Felzenszwalb & Huttenlocher).
+    ///   \param[in]  f       Input, 0 at feature pixels and kInf elsewhere.
+    ///   \param[out] d       Squared distances.
+    ///   \param[in]  v, z    Scratch, n and n+1 elements.
+    //------------------------------------------------------------------------//
+    static void edt_1d(const float *f, float *d, size_t n, int *v, float *z){
+      int k=0;
+      v[0]=0;
+      z[0]=-kInf;
+      z[1]= kInf;
+      for(int q=1; q < (int)n; ++q){
+        float s=((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+        while( s <= z[k] ){
+          --k;
+          s=((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+        }
+        ++k;
+        v[k]  =q;
+        z[k]  =s;
+        z[k+1]=kInf;
+      }
+
+      k=0;
+      for(int q=0; q < (int)n; ++q){
+        while( z[k+1] < q )
+          ++k;
+        float dist=q-v[k];
+        d[q]=dist*dist + f[v[k]];
+      }
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ static void edt_2d(std::vector<float> &grid, size_t w, size_t h)
+    /// In place 2D squared distance transform, columns then rows.
+    //------------------------------------------------------------------------//
+    static void edt_2d(std::vector<float> &grid, size_t w, size_t h){
+      size_t n=std::max(w, h);
+      std::vector<float>  f(n), d(n), z(n+1);
+      std::vector<int>    v(n);
+
+      for(size_t x=0; x < w; ++x){
+        for(size_t y=0; y < h; ++y)
+          f[y]=grid[y*w+x];
+        edt_1d(&f[0], &d[0], h, &v[0], &z[0]);
+        for(size_t y=0; y < h; ++y)
+          grid[y*w+x]=d[y];
+      }
+      for(size_t y=0; y < h; ++y){
+        edt_1d(&grid[y*w], &d[0], w, &v[0], &z[0]);
+        std::copy(d.begin(), d.begin()+w, grid.begin()+y*w);
+      }
+    }
+    //}}}---------------------------------------------------------------------//
+    //{{{ void generate(RasterGlyph &glyph, size_t spread)
+    /// Replaces the coverage bitmap of \a glyph with its distance field.
+    ///
+    /// The bitmap grows by \a spread pixels on every side (and the offset
+    /// moves accordingly), so the field can fall off to 0 around the
+    /// outline. Pixels on the outline take their distance from the
+    /// coverage, the rest from the distance transform of the 50% mask.
+    //------------------------------------------------------------------------//
+    void generate(RasterGlyph &glyph, size_t spread){
+      if( !glyph.loaded || !glyph.size.width || !glyph.size.height )
+        return;
+
+      const size_t w=glyph.size.width  + 2*spread;
+      const size_t h=glyph.size.height + 2*spread;
+
+      std::vector<byte> coverage(w*h, 0);
+      for(size_t y=0; y < glyph.size.height; ++y){
+        const byte *row=glyph.pixels.data() + y*glyph.size.width;
+        std::copy(row, row+glyph.size.width, &coverage[(y+spread)*w + spread]);
+      }
+
+      // Distance to the nearest inside pixel, and to the nearest outside one.
+      std::vector<float> toInside(w*h), toOutside(w*h);
+      for(size_t i=0; i < w*h; ++i){
+        bool inside =coverage[i] >= 128;
+        toInside[i] =( inside ? 0 : kInf );
+        toOutside[i]=( inside ? kInf : 0 );
+      }
+      edt_2d(toInside,  w, h);
+      edt_2d(toOutside, w, h);
+
+      glyph.pixels.resize(w*h);
+      const float scale=127.0f / spread;
+      for(size_t i=0; i < w*h; ++i){
+        float dist;
+        if( coverage[i] > 0 && coverage[i] < 255 )
+          dist=coverage[i] / 255.0f - 0.5f;
+        else if( coverage[i] >= 128 )
+          dist=std::sqrt(toOutside[i]) - 0.5f;
+        else
+          dist=0.5f - std::sqrt(toInside[i]);
+
+        float value=128.0f + dist*scale;
+        glyph.pixels[i]=static_cast<byte>( value < 0.0f   ? 0   :
+                                           value > 255.0f ? 255 :
+                                           value + 0.5f );
+      }
+
+      glyph.size.set(w, h);
+      glyph.off.x-=spread;
+      glyph.off.y-=spread;
+    }
+    //}}}
+  }
+}
@@ -0,0 +1,63 @@
+//==============================================================================
+/**
+\file            GlyphTable.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nGlyphTable.hpp"
+
+namespace ngl{
+  //--------------------------------------------------------------------------//
+  //{{{ GlyphTable()
+  /// \brief  Default constructor.
+  //--------------------------------------------------------------------------//
+  GlyphTable::GlyphTable()
+  :m_size(0),
+  m_pages(0){
+    memset(m_table, 0, sizeof(m_table));
+  }
+  //}}}-----------------------------------------------------------------------//
+  GlyphTable::~GlyphTable(){ //{{{
+    clear();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void insert(Codepoint code, Glyph *glyph)
+  /// Adds a glyph to the table, replacing the one already stored for \a code.
+  ///   \param[in]  code    Code point, values past kMaxCodepoint are ignored.
+  ///   \param[in]  glyph   Glyph to store, must outlive the table entry.
+  ///                       NULL removes the entry.
+  //--------------------------------------------------------------------------//
+  void GlyphTable::insert(Codepoint code, Glyph *glyph){
+    if( code > kMaxCodepoint )
+      return;
+
+    Page *&page=m_table[code >> kPageBits];
+    if( !page ){
+      page=new Page[1];
+      memset(page, 0, sizeof(Page));
+      ++m_pages;
+    }
+
+    Glyph *&slot=(*page)[code & kPageMask];
+    if( !slot && glyph )
+      ++m_size;
+    else if( slot && !glyph )
+      --m_size;
+    slot=glyph;
+  }
+  //}}}-----------------------------------------------------------------------//
+  void GlyphTable::clear(){ //{{{
+    for(size_t i=0; i < kNumPages; ++i){
+      delete[] m_table[i];
+      m_table[i]=NULL;
+    }
+    m_size  =0;
+    m_pages =0;
+  }
+  //}}}
+}
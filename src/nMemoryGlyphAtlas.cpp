@@ -0,0 +1,252 @@
+#include <nMemoryGlyphAtlas.hpp>
+#include <nAtlasRepacker.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace ngl{
+  //--------------------------------------------------------------------------//
+  // {{{ MemoryGlyphAtlas::MemoryGlyphAtlas(size_t width, size_t height)
+  /// \brief  Default constructor.
+  ///   \param[in]  width, height   Size of every page.
+  //--------------------------------------------------------------------------//
+  MemoryGlyphAtlas::MemoryGlyphAtlas(size_t width, size_t height)
+  :   m_size          ( width, height ),
+      m_maxPages      ( kMaxPages ),
+      m_current       ( 0 )
+  {
+    add_page();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ MemoryGlyphAtlas(const MemoryGlyphAtlas &obj)
+  /// Copy constructor.
+  ///   \param[in]  obj   MemoryGlyphAtlas to copy from.
+  ///
+  //--------------------------------------------------------------------------//
+  MemoryGlyphAtlas::MemoryGlyphAtlas(const MemoryGlyphAtlas &obj){
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ ~MemoryGlyphAtlas()
+  MemoryGlyphAtlas::~MemoryGlyphAtlas(){
+    for(size_t i=0; i < m_pages.size(); ++i)
+      delete m_pages[i];
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ MemoryGlyphAtlas& operator=(const MemoryGlyphAtlas &obj)
+  /// Assign operator
+  ///    \param[in] obj   MemoryGlyphAtlas to assign to this.
+  /// \returns
+  /// Reference to itself.
+  //--------------------------------------------------------------------------//
+  MemoryGlyphAtlas &MemoryGlyphAtlas::operator=(const MemoryGlyphAtlas &obj){
+    return *this;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Error add(Glyph &out, const byte *data, const Size2 &size)
+  /// Copies the glyph into its page.
+  //--------------------------------------------------------------------------//
+  Error MemoryGlyphAtlas::add(Glyph &out, const byte *data, const Size2 &size){
+    size_t  pitch;
+    byte    *dst=reserve(out, size, pitch);
+    if( !dst )
+      return ENotEnoughMemory;
+
+    for(size_t y=0; y < size.height; ++y)
+      memcpy(dst + y*pitch, data + y*size.width, size.width);
+    return EOk;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ byte* reserve(Glyph &out, const Size2 &size, size_t &pitch)
+  /// Packs a \a size glyph into the first page with room for it, starting
+  /// with the page used last, adding a page if there is none, and returns
+  /// its place in the page. See IGlyphAtlas::reserve.
+  ///
+  /// Starting with the last page keeps glyphs loaded together on the same
+  /// page, rather than spread over the gaps left in all of them, which
+  /// makes clear_page() (LRU eviction) effective.
+  //--------------------------------------------------------------------------//
+  byte* MemoryGlyphAtlas::reserve(Glyph &out, const Size2 &size,
+                                  size_t &pitch){
+    if( size.width > m_size.width || size.height > m_size.height ){
+      fprintf(stderr, "Glyph U+%04X (%ux%u) does not fit an atlas page.\n",
+              out.code, (unsigned)size.width, (unsigned)size.height);
+      return NULL;
+    }
+
+    uint2   off;
+    size_t  page=m_current;
+    size_t  tried=0;
+    while( tried < m_pages.size() && !m_pages[page]->packer.pack(size, off) ){
+      page=(page+1) % m_pages.size();
+      ++tried;
+    }
+    if( tried == m_pages.size() ){
+      // Full, it is up to the caller to free a page or give up.
+      if( m_pages.size() >= m_maxPages )
+        return NULL;
+      page=m_pages.size();
+      if( !add_page()->packer.pack(size, off) )
+        return NULL;
+    }
+    m_current=page;
+
+    Page &p=*m_pages[page];
+    set_texcoords(out, page, off, size);
+    mark_dirty(p, off, size);
+    pitch=m_size.width;
+    return &p.pixels[off.y*m_size.width + off.x];
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Error flush()
+  /// Nothing to upload, only forgets the dirty regions.
+  //--------------------------------------------------------------------------//
+  Error MemoryGlyphAtlas::flush(){
+    for(size_t i=0; i < m_pages.size(); ++i)
+      m_pages[i]->dirty.min=m_pages[i]->dirty.max=uint2(0, 0);
+    return EOk;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void set_page_limit(size_t pages)
+  /// Sets the number of pages reserve() may allocate, never more than
+  /// kMaxPages.
+  //--------------------------------------------------------------------------//
+  void MemoryGlyphAtlas::set_page_limit(size_t pages){
+    m_maxPages=( pages && pages < kMaxPages ? pages : kMaxPages );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool clear_page(size_t page)
+  /// Empties \a page. The whole page is marked dirty, so the linear
+  /// filtering of new glyphs can not pick up old ones once uploaded.
+  //--------------------------------------------------------------------------//
+  bool MemoryGlyphAtlas::clear_page(size_t page){
+    if( page >= m_pages.size() )
+      return false;
+
+    Page &p=*m_pages[page];
+    p.packer.clear();
+    std::fill(p.pixels.begin(), p.pixels.end(), 0);
+    mark_dirty(p, uint2(0, 0), m_size);
+    m_current=page;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool repack(const AtlasLayout &layout)
+  /// Copies every glyph of \a layout to its new place and takes over the
+  /// layout's packers. All pages are new, so they are all marked dirty, and
+  /// pages the layout does not need any more are removed. The layout may
+  /// use as many pages as there are now, even past the page limit.
+  //--------------------------------------------------------------------------//
+  bool MemoryGlyphAtlas::repack(const AtlasLayout &layout){
+    const size_t count=layout.pages.size();
+    if( !count || count > std::max(m_maxPages, m_pages.size())
+        || layout.pageSize.width  != m_size.width
+        || layout.pageSize.height != m_size.height )
+      return false;
+
+    std::vector< std::vector<byte> > pixels(count);
+    for(size_t i=0; i < count; ++i)
+      pixels[i].assign(m_size.width*m_size.height, 0);
+
+    for(size_t i=0; i < layout.transfers.size(); ++i){
+      const AtlasTransfer &t=layout.transfers[i];
+      const byte  *src=&m_pages[t.srcPage]->pixels[ t.src.y*m_size.width
+                                                    + t.src.x ];
+      byte        *dst=&pixels[t.dstPage][ t.dst.y*m_size.width + t.dst.x ];
+      for(size_t y=0; y < t.size.height; ++y)
+        memcpy(dst + y*m_size.width, src + y*m_size.width, t.size.width);
+      set_texcoords(*t.glyph, t.dstPage, t.dst, t.size);
+    }
+
+    while( m_pages.size() > count ){
+      page_removed(m_pages.size()-1);
+      delete m_pages.back();
+      m_pages.pop_back();
+    }
+    while( m_pages.size() < count )
+      add_page();
+    for(size_t i=0; i < count; ++i){
+      Page &p=*m_pages[i];
+      p.pixels.swap(pixels[i]);
+      p.packer=layout.pages[i];
+      mark_dirty(p, uint2(0, 0), m_size);
+    }
+    m_current=count-1;
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ const byte* pixels(size_t page) const
+  /// \returns
+  ///   Alpha bitmap of \a page, size() texels, or NULL.
+  //--------------------------------------------------------------------------//
+  const byte* MemoryGlyphAtlas::pixels(size_t page) const{
+    return ( page < m_pages.size() ? &m_pages[page]->pixels[0] : NULL );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ float occupancy() const
+  /// \returns
+  ///   Share of the allocated pages covered by glyphs, 0 to 1.
+  //--------------------------------------------------------------------------//
+  float MemoryGlyphAtlas::occupancy() const{
+    float sum=0.0f;
+    for(size_t i=0; i < m_pages.size(); ++i)
+      sum+=m_pages[i]->packer.occupancy();
+    return sum / m_pages.size();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ size_t waste() const
+  /// \returns
+  ///   Texels that can not be used any more, see SkylinePacker.
+  //--------------------------------------------------------------------------//
+  size_t MemoryGlyphAtlas::waste() const{
+    size_t sum=0;
+    for(size_t i=0; i < m_pages.size(); ++i)
+      sum+=m_pages[i]->packer.waste();
+    return sum;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void mark_dirty(Page &page, const uint2 &off, const Size2 &size)
+  /// Grows the dirty region of \a page to cover the \a size rectangle at
+  /// \a off.
+  //--------------------------------------------------------------------------//
+  void MemoryGlyphAtlas::mark_dirty(Page &page, const uint2 &off,
+                                    const Size2 &size){
+    if( !size.width || !size.height )
+      return;
+
+    Region &dirty=page.dirty;
+    if( dirty.max.x <= dirty.min.x || dirty.max.y <= dirty.min.y ){
+      dirty.min=off;
+      dirty.max.set(off.x+size.width, off.y+size.height);
+      return;
+    }
+    dirty.min.set( std::min<uint32_t>(dirty.min.x, off.x),
+                   std::min<uint32_t>(dirty.min.y, off.y) );
+    dirty.max.set( std::max<uint32_t>(dirty.max.x, off.x+size.width),
+                   std::max<uint32_t>(dirty.max.y, off.y+size.height) );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void set_texcoords(Glyph &out, size_t page, const uint2 &off, ...)
+  void MemoryGlyphAtlas::set_texcoords(Glyph &out, size_t page,
+                                       const uint2 &off, const Size2 &size){
+    out.owner       = this;
+    out.page        = page;
+    out.botLeft.u   = (float)off.x / (float)m_size.width;
+    out.botLeft.v   = (float)off.y / (float)m_size.height;
+    out.topRight.u  = (off.x+size.width)  / (float)m_size.width;
+    out.topRight.v  = (off.y+size.height) / (float)m_size.height;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ Page* add_page()
+  //--------------------------------------------------------------------------//
+  MemoryGlyphAtlas::Page* MemoryGlyphAtlas::add_page(){
+    Page *page=new Page;
+    page->pixels.assign(m_size.width*m_size.height, 0);
+    page->packer.init(m_size.width, m_size.height);
+    page->dirty.min=page->dirty.max=uint2(0, 0);
+    m_pages.push_back(page);
+    page_added(m_pages.size()-1);
+    return page;
+  }
+  //}}}
+}
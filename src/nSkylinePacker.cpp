@@ -0,0 +1,141 @@
+//==============================================================================
+/**
+\file            SkylinePacker.cpp
+\author          Mateusz 'novo' Klos
+\date            April 14, 2010
+
+
+
+Copyright (c) 2010 Mateusz 'novo' Klos
+*/
+//==============================================================================
+#include "nSkylinePacker.hpp"
+
+#include <algorithm>
+
+namespace ngl{
+  //--------------------------------------------------------------------------//
+  SkylinePacker::SkylinePacker() //{{{
+  :m_size(Size2::null), m_used(0), m_waste(0){
+  }
+  //}}}-----------------------------------------------------------------------//
+  SkylinePacker::SkylinePacker(size_t width, size_t height){ //{{{
+    init(width, height);
+  }
+  //}}}-----------------------------------------------------------------------//
+  void SkylinePacker::init(size_t width, size_t height){ //{{{
+    m_size.set(width, height);
+    clear();
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ void clear()
+  /// Forgets all packed rectangles.
+  //--------------------------------------------------------------------------//
+  void SkylinePacker::clear(){
+    Node floor={ 0, 0, static_cast<uint32_t>(m_size.width) };
+    m_skyline.assign(1, floor);
+    m_used  =0;
+    m_waste =0;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool pack(const Size2 &size, uint2 &off)
+  /// Finds a place for a \a size rectangle.
+  ///   \param[out] off   Bottom left corner of the rectangle.
+  /// \returns
+  ///   false if it does not fit anywhere.
+  //--------------------------------------------------------------------------//
+  bool SkylinePacker::pack(const Size2 &size, uint2 &off){
+    size_t    best      =m_skyline.size();
+    uint32_t  bestTop   =~0u;
+    uint32_t  bestWidth =~0u;
+    uint32_t  y;
+    for(size_t i=0; i < m_skyline.size(); ++i){
+      if( !fit(i, size, y) )
+        continue;
+      // Lowest top edge first, then the narrowest segment, to keep wide
+      // segments for wide glyphs.
+      uint32_t top=y + size.height;
+      if( top < bestTop ||
+          (top == bestTop && m_skyline[i].width < bestWidth) ){
+        best      =i;
+        bestTop   =top;
+        bestWidth =m_skyline[i].width;
+        off.set(m_skyline[i].x, y);
+      }
+    }
+    if( best == m_skyline.size() )
+      return false;
+    if( !size.width || !size.height )
+      return true;
+
+    // Gaps between the rectangle and the segments it rests on.
+    const uint32_t right=off.x + size.width;
+    for(size_t i=best; i < m_skyline.size() && m_skyline[i].x < right; ++i){
+      uint32_t end=std::min(right, m_skyline[i].x + m_skyline[i].width);
+      m_waste+=(end - m_skyline[i].x) * (off.y - m_skyline[i].y);
+    }
+    m_used+=size.width * size.height;
+
+    // The rectangle's top becomes a new segment, replacing whatever it
+    // covers.
+    Node node={ off.x, static_cast<uint32_t>(off.y + size.height),
+                static_cast<uint32_t>(size.width) };
+    m_skyline.insert(m_skyline.begin()+best, node);
+    for(size_t i=best+1; i < m_skyline.size(); ){
+      Node &n=m_skyline[i];
+      if( n.x >= right )
+        break;
+      if( n.x + n.width <= right ){
+        m_skyline.erase(m_skyline.begin()+i);
+        continue;
+      }
+      n.width-=right - n.x;
+      n.x     =right;
+      break;
+    }
+
+    // Merge neighbours at the same height.
+    for(size_t i=0; i+1 < m_skyline.size(); ){
+      if( m_skyline[i].y == m_skyline[i+1].y ){
+        m_skyline[i].width+=m_skyline[i+1].width;
+        m_skyline.erase(m_skyline.begin()+i+1);
+      }
+      else
+        ++i;
+    }
+    return true;
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ float occupancy() const
+  /// \returns
+  ///   Share of the area covered by packed rectangles, 0 to 1.
+  //--------------------------------------------------------------------------//
+  float SkylinePacker::occupancy() const{
+    size_t area=m_size.width * m_size.height;
+    return ( area ? (float)m_used / area : 0.0f );
+  }
+  //}}}-----------------------------------------------------------------------//
+  //{{{ bool fit(size_t index, const Size2 &size, uint32_t &y) const
+  /// Checks if a \a size rectangle fits with its left edge at the start of
+  /// segment \a index.
+  ///   \param[out] y   Height it would rest at.
+  //--------------------------------------------------------------------------//
+  bool SkylinePacker::fit(size_t index, const Size2 &size, uint32_t &y) const{
+    const uint32_t x=m_skyline[index].x;
+    if( x + size.width > m_size.width )
+      return false;
+
+    y=0;
+    size_t widthLeft=size.width;
+    for(size_t i=index; widthLeft > 0; ++i){
+      const Node &n=m_skyline[i];
+      if( n.y > y )
+        y=n.y;
+      if( y + size.height > m_size.height )
+        return false;
+      widthLeft-=std::min<size_t>(widthLeft, n.width);
+    }
+    return y + size.height <= m_size.height;
+  }
+  //}}}
+}
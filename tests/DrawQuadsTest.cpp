@@ -0,0 +1,150 @@
+//==============================================================================
+/**
+    \file            DrawQuadsTest.cpp
+
+  AbstractRenderer::draw_quads(): batches past Font::kMaxQuads quads are
+  drawn in chunks, every index reaching the right vertex. The few GL calls
+  it makes are replaced below, no context is needed.
+*/
+//==============================================================================
+#include "TestCommon.hpp"
+#include "nFontRenderers.hpp"
+
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <vector>
+
+using namespace ngl;
+
+namespace{
+  /// What the replaced GL calls saw.
+  struct DrawLog{
+    const Font::Vertex    *pointer;     // vertex array, as last set.
+    size_t                pointerSets;
+    size_t                draws;
+    bool                  outOfRange;   // an index read past quad_indices().
+    std::vector<const Font::Vertex*>  drawn;  // corners, in drawing order.
+  };
+  DrawLog g_draws;
+}
+
+void glVertexPointer(GLint, GLenum, GLsizei, const GLvoid *pointer){
+  g_draws.pointer=(const Font::Vertex*)( (const byte*)pointer
+                                         - OFFSET(Font::Vertex, position) );
+  ++g_draws.pointerSets;
+}
+void glTexCoordPointer(GLint, GLenum, GLsizei, const GLvoid*){
+}
+void glColorPointer(GLint, GLenum, GLsizei, const GLvoid*){
+}
+void glDrawElements(GLenum, GLsizei count, GLenum, const GLvoid *indices){
+  const uint16_t *first=(const uint16_t*)Font::quad_indices();
+  const uint16_t *index=(const uint16_t*)indices;
+  ++g_draws.draws;
+  if( index < first || index + count > first + Font::kMaxQuads*6 ){
+    g_draws.outOfRange=true;
+    return;
+  }
+  for(GLsizei i=0; i < count; ++i)
+    g_draws.drawn.push_back( g_draws.pointer + index[i] );
+}
+
+class DrawQuadsTest : public CxxTest::TestSuite{
+    /// Exposes nothing more, the renderer is only there for draw_quads().
+    class Renderer : public AbstractRenderer{
+      public:
+        virtual int render(const Font &font){ return EOk; }
+    };
+
+  public:
+    void setUp(){
+      N_TEST_SETUP();
+      g_draws=DrawLog();
+      m_vb.resize( (2*Font::kMaxQuads + 100)*4 );
+    }
+    //--------------------------------------------------------------------------//
+    void testSingleChunk(){
+      N_TEST_INFO();
+      size_t base=~(size_t)0;
+      draw(100, 300, base);
+      TS_ASSERT_EQUALS( g_draws.draws, 1u );
+      TS_ASSERT_EQUALS( g_draws.pointerSets, 1u );
+      check(100, 300);
+    }
+    //--------------------------------------------------------------------------//
+    /// Over two kMaxQuads boundaries, from the start and from the middle of
+    /// a chunk. Batches are whole quads, firstTri is always even.
+    //--------------------------------------------------------------------------//
+    void testChunks(){
+      N_TEST_INFO();
+      const size_t tris=(2*Font::kMaxQuads + 100)*2;
+      size_t base=~(size_t)0;
+      draw(0, tris, base);
+      TS_ASSERT_EQUALS( g_draws.draws, 3u );
+      check(0, tris);
+
+      g_draws=DrawLog();
+      base=~(size_t)0;
+      draw(Font::kMaxQuads*2 - 20, 200, base);
+      TS_ASSERT_EQUALS( g_draws.draws, 1u );
+      check(Font::kMaxQuads*2 - 20, 200);
+
+      g_draws=DrawLog();
+      base=~(size_t)0;
+      draw(14, tris-14, base);
+      TS_ASSERT_EQUALS( g_draws.draws, 3u );
+      check(14, tris-14);
+    }
+    //--------------------------------------------------------------------------//
+    /// Batches following each other keep the pointers while in reach, and
+    /// move them back for an earlier one.
+    //--------------------------------------------------------------------------//
+    void testSharedPointers(){
+      N_TEST_INFO();
+      size_t base=~(size_t)0;
+      draw(0, 200, base);
+      draw(200, 400, base);
+      draw(600, 2*Font::kMaxQuads - 600, base);
+      TS_ASSERT_EQUALS( g_draws.pointerSets, 1u );
+      check(0, 2*Font::kMaxQuads);
+
+      draw(2*Font::kMaxQuads, 10, base);
+      TS_ASSERT_EQUALS( g_draws.pointerSets, 2u );
+      draw(4, 2, base);
+      TS_ASSERT_EQUALS( g_draws.pointerSets, 3u );
+      TS_ASSERT( !g_draws.outOfRange );
+    }
+
+  private:
+    void draw(size_t firstTri, size_t triCount, size_t &base){
+      Renderer renderer;
+      renderer.draw_quads(&m_vb[0], firstTri, triCount, Font::quad_indices(),
+                          base);
+    }
+    /// The corners drawn must be those of triangles [first, first+count)
+    /// of one quad_indices() pattern spanning the whole vertex buffer.
+    void check(size_t firstTri, size_t triCount){
+      TS_ASSERT( !g_draws.outOfRange );
+      TS_ASSERT_EQUALS( g_draws.drawn.size(), triCount*3 );
+      if( g_draws.drawn.size() != triCount*3 )
+        return;
+
+      const Triangle16 *pattern=Font::quad_indices();
+      size_t            wrong  =0;
+      for(size_t t=0; t < triCount; ++t){
+        const size_t      tri =firstTri + t;
+        const Triangle16  &ref=pattern[tri & 1];
+        const size_t      v   =(tri/2)*4;
+        const Font::Vertex *corners[3]={ &m_vb[v + ref.a], &m_vb[v + ref.b],
+                                         &m_vb[v + ref.c] };
+        for(size_t c=0; c < 3; ++c){
+          if( g_draws.drawn[t*3 + c] != corners[c] )
+            ++wrong;
+        }
+      }
+      TS_ASSERT_EQUALS( wrong, 0u );
+    }
+
+    std::vector<Font::Vertex> m_vb;
+};
@@ -0,0 +1,83 @@
+//==============================================================================
+/**
+    \file            FontCacheTest.cpp
+
+  Font's string cache: texts whose keys collide are both kept and both
+  drawn, in the same frame and the frames after.
+*/
+//==============================================================================
+#include "TestCommon.hpp"
+#include "nFont.hpp"
+#include "nFontFace.hpp"
+
+#include <cstring>
+#include <vector>
+
+using namespace ngl;
+
+class FontCacheTest : public CxxTest::TestSuite{
+    /// Every text gets the same key.
+    class CollidingFont : public Font{
+      public:
+        CollidingFont(const String &face, size_t sizeInPt, uint32_t flags)
+        :Font(face, sizeInPt, flags) {}
+
+      protected:
+        virtual Hash64_t cache_key(const String &/*msg*/,
+                                   const Color32 &/*color*/,
+                                   bool /*colorCodes*/) const{
+          return 42;
+        }
+    };
+
+  public:
+    void setUp(){
+      N_TEST_SETUP();
+      if( !freetype::initialized() )
+        freetype::init();
+    }
+    //--------------------------------------------------------------------------//
+    void testCollision(){
+      N_TEST_INFO();
+      const char *path=test_font();
+      if( !path )
+        return;
+
+      CollidingFont colliding(path, 14, FaceFlags::Headless);
+      Font          reference(path, 14, FaceFlags::Headless);
+      for(int frame=0; frame < 4; ++frame){
+        print_frame(colliding);
+        print_frame(reference);
+        if( frame == 0 )
+          TS_ASSERT_EQUALS( colliding.cache_misses(), 3u );
+
+        std::vector<Font::Vertex> got, expected;
+        geometry(colliding, got);
+        geometry(reference, expected);
+        TS_ASSERT_EQUALS( got.size(), expected.size() );
+        TS_ASSERT( got.size() == expected.size()
+                   && !memcmp(&got[0], &expected[0],
+                              got.size()*sizeof(Font::Vertex)) );
+      }
+      // Built once, not evicting each other every frame.
+      TS_ASSERT_EQUALS( colliding.cache_misses(), 3u );
+      TS_ASSERT_EQUALS( colliding.cache_hits(), 4*4u - 3u );
+    }
+
+  private:
+    /// Three texts, one of them twice; red text collides with white too.
+    static void print_frame(Font &font){
+      font.init_position(768);
+      font.print("first\n");
+      font.print("second\n", Color32::red);
+      font.print("first\n");
+      font.print("third\n");
+    }
+    static void geometry(Font &font, std::vector<Font::Vertex> &vb){
+      Font::Batches batches;
+      font.update_cache();
+      vb.resize(font.vertex_count());
+      if( !vb.empty() )
+        font.get_geometry(&vb[0], batches);
+    }
+};
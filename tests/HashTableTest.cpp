@@ -0,0 +1,133 @@
+//==============================================================================
+/**
+    \file            HashTableTest.cpp
+
+  HashTable: lookups, replacing, erase() shifting the probe sequence back.
+*/
+//==============================================================================
+#include "TestCommon.hpp"
+#include "nFont.hpp"
+
+#include <map>
+#include <vector>
+
+using namespace ngl;
+
+class HashTableTest : public CxxTest::TestSuite{
+  public:
+    void setUp(){
+      N_TEST_SETUP();
+    }
+    //--------------------------------------------------------------------------//
+    void testInsertFind(){
+      N_TEST_INFO();
+      HashTable<int> table;
+      TS_ASSERT_EQUALS( table.size(), 0u );
+      TS_ASSERT_IS_NULL( table.find(1) );
+
+      table.insert(1, 10);
+      table.insert(2, 20);
+      TS_ASSERT_EQUALS( table.size(), 2u );
+      TS_ASSERT( table.find(1) && *table.find(1) == 10 );
+      TS_ASSERT( table.find(2) && *table.find(2) == 20 );
+      TS_ASSERT_IS_NULL( table.find(3) );
+
+      table.insert(1, 11);
+      TS_ASSERT_EQUALS( table.size(), 2u );
+      TS_ASSERT( table.find(1) && *table.find(1) == 11 );
+
+      table.clear();
+      TS_ASSERT_EQUALS( table.size(), 0u );
+      TS_ASSERT_IS_NULL( table.find(1) );
+    }
+    //--------------------------------------------------------------------------//
+    void testGrow(){
+      N_TEST_INFO();
+      HashTable<Hash64_t> table(16);
+      for(Hash64_t h=1; h <= 1000; ++h)
+        table.insert(h*7919, h);
+      TS_ASSERT_EQUALS( table.size(), 1000u );
+      TS_ASSERT_LESS_THAN_EQUALS( table.size()*4, table.capacity()*3 );
+      for(Hash64_t h=1; h <= 1000; ++h)
+        TS_ASSERT( table.find(h*7919) && *table.find(h*7919) == h );
+    }
+    //--------------------------------------------------------------------------//
+    /// Entries of one cluster must stay reachable whichever of them goes,
+    /// also when the cluster wraps around the end of the slots.
+    //--------------------------------------------------------------------------//
+    void testEraseShiftsBack(){
+      N_TEST_INFO();
+      const size_t slots=16;
+      for(size_t start=0; start < slots; ++start){
+        const std::vector<Hash64_t> keys=cluster(start, slots);
+        for(size_t gone=0; gone < keys.size(); ++gone){
+          HashTable<size_t> table(slots);
+          for(size_t i=0; i < keys.size(); ++i)
+            table.insert(keys[i], i);
+          TS_ASSERT_EQUALS( table.capacity(), slots );
+
+          TS_ASSERT( table.erase(keys[gone]) );
+          TS_ASSERT( !table.erase(keys[gone]) );
+          TS_ASSERT_EQUALS( table.size(), keys.size()-1 );
+          TS_ASSERT_IS_NULL( table.find(keys[gone]) );
+          for(size_t i=0; i < keys.size(); ++i){
+            if( i != gone )
+              TS_ASSERT( table.find(keys[i]) && *table.find(keys[i]) == i );
+          }
+        }
+      }
+    }
+    //--------------------------------------------------------------------------//
+    /// Inserting and erasing at a constant size must not fill the table
+    /// (no tombstones), nor lose anything.
+    //--------------------------------------------------------------------------//
+    void testChurn(){
+      N_TEST_INFO();
+      HashTable<Hash64_t>           table;
+      std::map<Hash64_t, Hash64_t>  ref;
+      uint64_t                      seed=12345;
+      for(size_t step=0; step < 20000; ++step){
+        seed=seed*6364136223846793005ull + 1442695040888963407ull;
+        const Hash64_t key=(seed >> 33) % 512;
+        if( ref.size() < 100 || (seed >> 20) & 1 ){
+          table.insert(key, step);
+          ref[key]=step;
+        }
+        else{
+          TS_ASSERT_EQUALS( table.erase(key), ref.erase(key) == 1 );
+        }
+      }
+      TS_ASSERT_EQUALS( table.size(), ref.size() );
+      TS_ASSERT_LESS_THAN_EQUALS( table.capacity(), 1024u );
+      for(Hash64_t key=0; key < 512; ++key){
+        std::map<Hash64_t, Hash64_t>::const_iterator it=ref.find(key);
+        if( it == ref.end() )
+          TS_ASSERT_IS_NULL( table.find(key) );
+        else
+          TS_ASSERT( table.find(key) && *table.find(key) == it->second );
+      }
+    }
+
+  private:
+    /// Slot HashTable puts \a hash at first in a table of \a slots.
+    static size_t home(Hash64_t hash, size_t slots){
+      uint32_t shift=64;
+      for(size_t n=slots; n > 1; n>>=1)
+        --shift;
+      return (hash * 0x9e3779b97f4a7c15ull) >> shift;
+    }
+    /// Keys forming one run of slots from \a start: two at home there, one
+    /// at each of the next two slots, and one more at home at start.
+    static std::vector<Hash64_t> cluster(size_t start, size_t slots){
+      const size_t homes[]={ start, start, (start+1) % slots,
+                             (start+2) % slots, start };
+      std::vector<Hash64_t> keys;
+      Hash64_t              key=1;
+      for(size_t i=0; i < sizeof(homes)/sizeof(homes[0]); ++i){
+        while( home(key, slots) != homes[i] )
+          ++key;
+        keys.push_back(key++);
+      }
+      return keys;
+    }
+};
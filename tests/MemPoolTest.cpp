@@ -0,0 +1,154 @@
+//==============================================================================
+/**
+    \file            MemPoolTest.cpp
+
+  MemPool: best fit, merging freed chunks, defragment() moves.
+*/
+//==============================================================================
+#include "TestCommon.hpp"
+#include "nFontTypes.hpp"
+
+#include <cstring>
+#include <list>
+#include <vector>
+
+using namespace ngl;
+
+class MemPoolTest : public CxxTest::TestSuite{
+  public:
+    void setUp(){
+      N_TEST_SETUP();
+    }
+    //--------------------------------------------------------------------------//
+    void testAlloc(){
+      N_TEST_INFO();
+      MemPool pool;
+      pool.init(256);
+      TS_ASSERT_EQUALS( pool.size(), 256u );
+      TS_ASSERT_EQUALS( pool.available(), 256u );
+      TS_ASSERT_EQUALS( pool.largest(), 256u );
+
+      byte *a=(byte*)pool.alloc(3);
+      byte *b=(byte*)pool.alloc(MemPool::kAlignment);
+      TS_ASSERT( a && b );
+      TS_ASSERT_EQUALS( (size_t)(a - pool.data()) % MemPool::kAlignment, 0u );
+      TS_ASSERT_EQUALS( (size_t)(b - pool.data()) % MemPool::kAlignment, 0u );
+      TS_ASSERT_EQUALS( pool.available(), 256u - 2*MemPool::kAlignment );
+
+      TS_ASSERT_IS_NULL( pool.alloc(512) );
+      TS_ASSERT( pool.alloc(pool.available()) );
+      TS_ASSERT_EQUALS( pool.available(), 0u );
+      TS_ASSERT_IS_NULL( pool.alloc(1) );
+    }
+    //--------------------------------------------------------------------------//
+    /// Freeing in any order gives back a single chunk.
+    //--------------------------------------------------------------------------//
+    void testCoalesce(){
+      N_TEST_INFO();
+      const size_t orders[][3]={ {0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                                 {1, 2, 0}, {2, 0, 1}, {2, 1, 0} };
+      for(size_t o=0; o < sizeof(orders)/sizeof(orders[0]); ++o){
+        MemPool pool;
+        pool.init(96);
+        MemAddr_t chunks[3];
+        for(size_t i=0; i < 3; ++i)
+          chunks[i]=pool.alloc(32);
+        TS_ASSERT_EQUALS( pool.available(), 0u );
+
+        for(size_t i=0; i < 3; ++i)
+          pool.free( chunks[ orders[o][i] ] );
+        TS_ASSERT_EQUALS( pool.available(), 96u );
+        TS_ASSERT_EQUALS( pool.largest(), 96u );
+        TS_ASSERT_EQUALS( pool.alloc(96), (MemAddr_t)pool.data() );
+      }
+    }
+    //--------------------------------------------------------------------------//
+    void testBestFit(){
+      N_TEST_INFO();
+      MemPool pool;
+      pool.init(160);
+      MemAddr_t big  =pool.alloc(64);
+      MemAddr_t keep1=pool.alloc(16);
+      MemAddr_t small=pool.alloc(32);
+      MemAddr_t keep2=pool.alloc(48);
+      TS_ASSERT( big && keep1 && small && keep2 );
+      pool.free(big);
+      pool.free(small);
+
+      TS_ASSERT_EQUALS( pool.largest(), 64u );
+      TS_ASSERT_EQUALS( pool.alloc(24), small );
+      TS_ASSERT_EQUALS( pool.alloc(40), big );
+    }
+    //--------------------------------------------------------------------------//
+    /// Freeing something the pool did not give out changes nothing.
+    //--------------------------------------------------------------------------//
+    void testFreeForeign(){
+      N_TEST_INFO();
+      MemPool pool;
+      pool.init(64);
+      byte *a=(byte*)pool.alloc(16);
+      byte  outside;
+      pool.free(&outside);
+      pool.free(a+1);
+      TS_ASSERT_EQUALS( pool.available(), 48u );
+      pool.free(a);
+      TS_ASSERT_EQUALS( pool.available(), 64u );
+    }
+    //--------------------------------------------------------------------------//
+    /// The moves reported must carry every live allocation to where its
+    /// data is now, packed at the front, with one free chunk behind.
+    //--------------------------------------------------------------------------//
+    void testDefragment(){
+      N_TEST_INFO();
+      MemPool pool;
+      pool.init(1024);
+      std::vector<byte*>  chunks;
+      std::vector<size_t> sizes;
+      for(size_t i=0; i < 20; ++i){
+        const size_t size=8 + (i*24) % 40;
+        byte *chunk=(byte*)pool.alloc(size);
+        TS_ASSERT( chunk );
+        memset(chunk, (int)i, size);
+        chunks.push_back(chunk);
+        sizes.push_back(size);
+      }
+      size_t live=0;
+      for(size_t i=0; i < chunks.size(); ++i){
+        if( i % 3 == 1 ){
+          pool.free(chunks[i]);
+          chunks[i]=NULL;
+        }
+        else
+          live+=sizes[i];
+      }
+      TS_ASSERT_LESS_THAN( pool.largest(), pool.available() );
+
+      std::list<MemAddr2> moves;
+      pool.defragment(moves);
+      TS_ASSERT( !moves.empty() );
+      for(std::list<MemAddr2>::const_iterator it=moves.begin();
+          it != moves.end(); ++it){
+        TS_ASSERT_LESS_THAN( it->y, it->x );
+        for(size_t i=0; i < chunks.size(); ++i){
+          if( chunks[i] == it->x )
+            chunks[i]=(byte*)it->y;
+        }
+      }
+
+      TS_ASSERT_EQUALS( pool.available(), pool.size() - live );
+      TS_ASSERT_EQUALS( pool.largest(), pool.available() );
+      for(size_t i=0; i < chunks.size(); ++i){
+        if( !chunks[i] )
+          continue;
+        TS_ASSERT_LESS_THAN_EQUALS( chunks[i] + sizes[i], pool.data() + live );
+        for(size_t b=0; b < sizes[i]; ++b)
+          TS_ASSERT_EQUALS( chunks[i][b], (byte)i );
+      }
+      TS_ASSERT_EQUALS( pool.alloc(pool.available()),
+                        (MemAddr_t)(pool.data() + live) );
+
+      // Packed already, nothing to move.
+      pool.defragment(moves);
+      TS_ASSERT( moves.empty() );
+    }
+};
@@ -0,0 +1,198 @@
+//==============================================================================
+/**
+    \file            ResidentTest.cpp
+
+  Font::Resident: a copy kept up to date with only the uploads ranges has
+  to draw what get_geometry() returns, frame after frame, while strings
+  come, go and the resident buffer fills, grows and is defragmented.
+*/
+//==============================================================================
+#include "TestCommon.hpp"
+#include "nFont.hpp"
+#include "nFontFace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace ngl;
+
+class ResidentTest : public CxxTest::TestSuite{
+    /// One quad as drawn: texture and its 4 vertices where they end up.
+    struct Quad{
+      TextureID     texID;
+      int           channel;
+      Font::Vertex  verts[4];
+
+      bool operator<(const Quad &obj) const{
+        if( texID != obj.texID )
+          return texID < obj.texID;
+        if( channel != obj.channel )
+          return channel < obj.channel;
+        return memcmp(verts, obj.verts, sizeof(verts)) < 0;
+      }
+      bool operator==(const Quad &obj) const{
+        return texID == obj.texID && channel == obj.channel
+               && !memcmp(verts, obj.verts, sizeof(verts));
+      }
+    };
+    typedef std::vector<Quad>   Quads;
+
+    /// What a buffer object mirroring Font::resident() would hold.
+    struct Mirror{
+      std::vector<Font::Vertex> vb;
+      uint32_t                  serial;
+      size_t                    uploaded;   // vertices, by the last update.
+
+      Mirror() :serial(0), uploaded(0) {}
+
+      void update(const Font::Resident &resident){
+        uploaded=0;
+        if( resident.capacity != vb.size()
+            || ( serial != resident.prevSerial && serial != resident.serial ) ){
+          vb.assign(resident.vb, resident.vb + resident.capacity);
+          uploaded=resident.capacity;
+        }
+        else if( serial == resident.prevSerial ){
+          for(size_t i=0; i < resident.uploads.size(); ++i){
+            const Chunk &range=resident.uploads[i];
+            TS_ASSERT_LESS_THAN_EQUALS( range.off + range.size, vb.size() );
+            std::copy(resident.vb + range.off,
+                      resident.vb + range.off + range.size,
+                      vb.begin() + range.off);
+            uploaded+=range.size;
+          }
+        }
+        serial=resident.serial;
+      }
+    };
+
+  public:
+    void setUp(){
+      N_TEST_SETUP();
+      if( !freetype::initialized() )
+        freetype::init();
+    }
+    //--------------------------------------------------------------------------//
+    void testDeltas(){
+      N_TEST_INFO();
+      const char *path=test_font();
+      if( !path )
+        return;
+
+      Font      font(path, 14, FaceFlags::Headless);
+      Mirror    mirror;
+      char      line[64];
+      uint64_t  seed=7;
+      for(int frame=0; frame < 90; ++frame){
+        // Static, then a few lines changing every frame, then a churning
+        // number of them.
+        int lines=100;
+        if( frame >= 60 ){
+          seed=seed*6364136223846793005ull + 1442695040888963407ull;
+          lines=20 + (seed >> 33) % 400;
+        }
+        font.init_position(768);
+        for(int i=0; i < lines; ++i){
+          const bool changing=( frame >= 30 && i % 9 == 0 );
+          snprintf(line, sizeof(line), "line %d: %d\n", i,
+                   changing ? frame : 0);
+          font.print(line);
+        }
+        if( !check_frame(font, mirror, frame) )
+          return;
+        if( frame > 0 && frame < 30 )
+          TS_ASSERT_EQUALS( mirror.uploaded, 0u );
+      }
+    }
+    //--------------------------------------------------------------------------//
+    /// Nearly fills the resident buffer, then frees every other line and
+    /// prints lines too long for the holes.
+    //--------------------------------------------------------------------------//
+    void testDefragment(){
+      N_TEST_INFO();
+      const char *path=test_font();
+      if( !path )
+        return;
+
+      Font    font(path, 14, FaceFlags::Headless);
+      Mirror  mirror;
+      char    line[64];
+      size_t  capacity=0;
+      for(int frame=0; frame < 20; ++frame){
+        font.init_position(768);
+        for(int i=0; i < 400; ++i){
+          if( frame >= 10 && i % 2 == 0 )
+            continue;
+          snprintf(line, sizeof(line), "line %03d\n", i);
+          font.print(line);
+        }
+        if( frame >= 10 )
+          font.print(String(600 + frame, 'x'));
+        if( !check_frame(font, mirror, frame) )
+          return;
+        if( frame == 0 )
+          capacity=font.resident().capacity;
+      }
+      // Made room in place.
+      TS_ASSERT_EQUALS( font.resident().capacity, capacity );
+    }
+
+  private:
+    /// Updates the font and \a mirror and compares what they draw.
+    static bool check_frame(Font &font, Mirror &mirror, int frame){
+      font.update_cache();
+      const Font::Resident &resident=font.resident();
+      mirror.update(resident);
+
+      std::vector<Font::Vertex> vb(font.vertex_count());
+      Font::Batches             batches;
+      font.get_geometry(vb.empty() ? NULL : &vb[0], batches);
+      Quads expected=geometry_quads(vb, batches);
+      Quads drawn   =resident_quads(mirror, resident);
+      TS_ASSERT_EQUALS( drawn.size()*4, font.vertex_count() );
+      std::sort(expected.begin(), expected.end());
+      std::sort(drawn.begin(), drawn.end());
+      TS_ASSERT( drawn == expected );
+      if( !(drawn == expected) ){
+        tlog("frame %d: resident differs from get_geometry()\n", frame);
+        return false;
+      }
+      return true;
+    }
+    static Quads geometry_quads(const std::vector<Font::Vertex> &vb,
+                                const Font::Batches &batches){
+      Quads quads;
+      for(size_t b=0; b < batches.size(); ++b){
+        const Font::Batch &batch=batches[b];
+        for(size_t q=batch.firstTri/2; q < (batch.firstTri+batch.triCount)/2;
+            ++q){
+          Quad quad;
+          quad.texID  =batch.texID;
+          quad.channel=batch.channel;
+          std::copy(&vb[q*4], &vb[q*4] + 4, quad.verts);
+          quads.push_back(quad);
+        }
+      }
+      return quads;
+    }
+    static Quads resident_quads(const Mirror &mirror,
+                                const Font::Resident &resident){
+      Quads quads;
+      for(size_t d=0; d < resident.draws.size(); ++d){
+        const Font::Draw  &draw =resident.draws[d];
+        const Font::Batch &batch=draw.batch;
+        for(size_t q=batch.firstTri/2; q < (batch.firstTri+batch.triCount)/2;
+            ++q){
+          Quad quad;
+          quad.texID  =batch.texID;
+          quad.channel=batch.channel;
+          std::copy(&mirror.vb[q*4], &mirror.vb[q*4] + 4, quad.verts);
+          for(size_t v=0; v < 4; ++v)
+            quad.verts[v].position+=draw.offset;
+          quads.push_back(quad);
+        }
+      }
+      return quads;
+    }
+};
@@ -15,6 +15,8 @@
 #include <cxxtest/TestSuite.h>
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
 
 #if !defined(_MSCVER)
 #  define __FUNCSIG__ __PRETTY_FUNCTION__
@@ -66,6 +68,21 @@ inline void tlog(const char *fmt, ...){
   delete[] ret[buffIndex-1];
 }
 
+/// Font file for the tests drawing text, $N_TEST_FONT or the one main
+/// uses; NULL (the test is skipped) if it cannot be read.
+inline const char* test_font(){
+  const char *path=getenv("N_TEST_FONT");
+  if( !path )
+    path="Inconsolata.otf";
+  FILE *file=fopen(path, "rb");
+  if( !file ){
+    tlog("No font at %s, set N_TEST_FONT; skipped.\n", path);
+    return NULL;
+  }
+  fclose(file);
+  return path;
+}
+
 class LogFixture : public CxxTest::GlobalFixture{
 public:
     bool setUpWorld(){